@@ -0,0 +1,138 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#pragma once
+
+#include <gba_types.h>
+#include "report.h"
+#include "test.h"
+
+/*
+** Test harness for timing tests that run the same code from several memory
+** regions.
+**
+** `NEW_HARNESS_TEST()` emits the body of a test once, in ROM, in a section of
+** its own that ends with its literal pool and an `_end` label. The body only
+** uses PC-relative and absolute addressing, so `harness_run()` can copy it
+** as-is to IWRAM or EWRAM and run it from there, depending on the kind of the
+** test it was registered with.
+**
+** Bodies must not call other functions: `bl` is PC-relative and wouldn't
+** survive the copy.
+**
+** Within `_code`, `samples` is an array of `u16` the test fills, initialized
+** to `0xDEAD`. It is compared against `_expected[kind][waitstates]` and
+** recorded in the result record once the body returns.
+**
+** Tests running from ROM run once per waitstate setting of the region they
+** run from, `HARNESS_WS(n, s)` being the setting where that region's N and S
+** fields of WAITCNT are `n` and `s`. `HARNESS_WS(0, 0)` is the power-on
+** setting, and the only one of the other kinds. The setting is reported in
+** the upper byte of the variant, the kind in the lower one.
+**
+** Settings whose expected samples are all 0 have no golden yet: they are
+** recorded but count neither as passed nor failed.
+**
+** `NEW_HARNESS_TEST_THUMB()` is the same, but the body is compiled in THUMB
+** state, inline assembly included. Its runs are reported with
+** `HARNESS_VARIANT_THUMB` set in their variant.
+*/
+
+#define HARNESS_MAX_SAMPLES     REPORT_MAX_SAMPLES
+#define HARNESS_MAX_BODY_SIZE   0x400
+#define HARNESS_WAITSTATES_MAX  8
+
+#define HARNESS_WS(_n, _s)              ((_n) | ((_s) << 2))
+#define HARNESS_VARIANT(_kind, _ws)     ((_kind) | ((_ws) << 8))
+#define HARNESS_VARIANT_THUMB           0x80
+
+typedef void (*harness_body_t)(u16 *out, u32 waitcnt);
+
+struct harness_test {
+    harness_body_t body;
+    u8 const *body_end;
+    size_t nb_samples;
+    u16 const *expected;
+};
+
+#define NEW_HARNESS_TEST(_name, _expected, _code)                           \
+    NEW_HARNESS_TEST_STATE(_name, _expected, "arm", _code)
+
+#define NEW_HARNESS_TEST_THUMB(_name, _expected, _code)                     \
+    NEW_HARNESS_TEST_STATE(_name, _expected, "thumb", _code)
+
+#define NEW_HARNESS_TEST_STATE(_name, _expected, _state, _code)             \
+    __attribute__((                                                         \
+        section(".text.harness." #_name),                                   \
+        noinline,                                                           \
+        target(_state)                                                      \
+    ))                                                                      \
+    static                                                                  \
+    void                                                                    \
+    _name##_body(                                                           \
+        u16 *out,                                                           \
+        u32 waitcnt                                                         \
+    ) {                                                                     \
+        u16 samples[sizeof((_expected)[0][0]) / sizeof(u16)];               \
+        u32 i;                                                              \
+                                                                            \
+        REG_WAITCNT = waitcnt;                                              \
+                                                                            \
+        for (i = 0; i < sizeof(samples) / sizeof(u16); ++i) {               \
+            samples[i] = 0xDEAD;                                            \
+        }                                                                   \
+                                                                            \
+        _code;                                                              \
+                                                                            \
+        for (i = 0; i < sizeof(samples) / sizeof(u16); ++i) {               \
+            out[i] = samples[i];                                            \
+        }                                                                   \
+    }                                                                       \
+                                                                            \
+    __asm__(                                                                \
+        ".pushsection .text.harness." #_name ",\"ax\",%progbits\n"          \
+        ".ltorg\n"                                                          \
+        #_name "_body_end:\n"                                               \
+        ".popsection\n"                                                     \
+    );                                                                      \
+                                                                            \
+    extern u8 const _name##_body_end[];                                     \
+                                                                            \
+    static struct harness_test const _name = {                              \
+        .body = _name##_body,                                               \
+        .body_end = _name##_body_end,                                       \
+        .nb_samples = sizeof((_expected)[0][0]) / sizeof(u16),              \
+        .expected = (u16 const *)(_expected),                               \
+    };                                                                      \
+                                                                            \
+    static_assert(                                                          \
+        sizeof((_expected)[0]) / sizeof((_expected)[0][0])                  \
+        == HARNESS_WAITSTATES_MAX                                           \
+    );                                                                      \
+                                                                            \
+    static_assert(sizeof((_expected)[0][0]) / sizeof(u16) <= HARNESS_MAX_SAMPLES)
+
+#define REGISTER_HARNESS_TEST(_suite, _idx, _kind, _name)                   \
+    REGISTER_TEST(_suite, _idx, _kind, harness_run, &(_name))
+
+/*
+** Register `_name` for every kind.
+*/
+#define REGISTER_HARNESS_TEST_ALL_KINDS(_suite, _idx, _name)                        \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_ROM_WITHOUT_PREFETCH, _name);     \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_ROM_WITH_PREFETCH, _name);        \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_ROM_WS1_WITHOUT_PREFETCH, _name); \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_ROM_WS1_WITH_PREFETCH, _name);    \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_ROM_WS2_WITHOUT_PREFETCH, _name); \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_ROM_WS2_WITH_PREFETCH, _name);    \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_IWRAM, _name);                    \
+    REGISTER_HARNESS_TEST(_suite, _idx, TEST_KIND_EWRAM, _name)
+
+/* source/common/harness.c */
+void harness_run(struct test const *test);
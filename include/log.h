@@ -0,0 +1,65 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#pragma once
+
+#include <gba_types.h>
+
+/*
+** Everything logged is drawn on screen by the text renderer and, if one is
+** available, sent to the emulator's debug port.
+**
+** The debug port can be picked at build time with `DEBUG_PORT`, or detected
+** at boot (the default). When `HEADLESS` is set, nothing is drawn on screen
+** and the debug port is the only output.
+**
+** There is no `printf()`: numbers are formatted with `log_hex()` and
+** `log_dec()`, which keeps newlib's formatting code out of the ROMs.
+*/
+
+#define DEBUG_PORT_NONE         0
+#define DEBUG_PORT_MGBA         1
+#define DEBUG_PORT_NOCASH       2
+#define DEBUG_PORT_AUTO         3
+
+#ifndef DEBUG_PORT
+# define DEBUG_PORT             DEBUG_PORT_AUTO
+#endif
+
+#ifndef HEADLESS
+# define HEADLESS               0
+#endif
+
+/*
+** mGBA's debug registers.
+**
+** Messages are written in `REG_MGBA_DEBUG_STRING` and sent, one line at a time,
+** by writing their log level to `REG_MGBA_DEBUG_FLAGS`.
+*/
+#define REG_MGBA_DEBUG_STRING   ((vu8 *)0x04FFF600)
+#define REG_MGBA_DEBUG_FLAGS    *(vu16 *)0x04FFF700
+#define REG_MGBA_DEBUG_ENABLE   *(vu16 *)0x04FFF780
+#define MGBA_DEBUG_STRING_LEN   0x100
+#define MGBA_DEBUG_LEVEL_INFO   3
+#define MGBA_DEBUG_SEND         (1 << 8)
+#define MGBA_DEBUG_REQUEST      0xC0DE
+#define MGBA_DEBUG_ACK          0x1DEA
+
+/*
+** No$gba's debug registers.
+*/
+#define REG_NOCASH_ID           ((vu8 *)0x04FFFA00)
+#define REG_NOCASH_CHAR_OUT     *(vu8 *)0x04FFFA18
+
+/* source/common/log.c */
+void log_init(void);
+void log_putc(char c);
+void log_puts(char const *str);
+void log_hex(u32 value, size_t digits);
+void log_dec(u32 value, size_t width);
@@ -0,0 +1,152 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#pragma once
+
+#include <gba_types.h>
+#include <assert.h>
+
+/*
+** Machine-readable result record.
+**
+** Every test writes one entry to a record living at a fixed address at the end
+** of EWRAM. The record is also mirrored, byte by byte, at the
+** beginning of the cartridge's SRAM, so emulators that only flush their `.sav`
+** file on exit expose it too.
+**
+** All fields are little-endian. The layout is:
+**
+**     0x00  struct report_header
+**     0x14  header.nb_entries entries, header.entries_size bytes in total
+**
+** Each entry is a `struct report_entry` followed by its `nb_samples` measured
+** samples and then by as many expected samples, so entries are as long as
+** their samples need. Samples are stored on 16 bits when all of them fit,
+** which `REPORT_ENTRY_16BIT` in `flags` tells, and on 32 bits otherwise.
+** `report_next()` returns the entry following another.
+**
+** That way, the record of `hades-tests.gba`, the longest, takes about 27KB of
+** its `REPORT_SIZE` bytes even if every test fails.
+**
+** The SRAM between the record and the test selection block, `REPORT_LOG_SIZE`
+** bytes at `REPORT_LOG_SRAM_ADDR`, is left to suites dumping more than their
+** samples: `scheduler-load` writes its event log there.
+**
+** `nb_tests` counts every test that ran, even those that didn't fit in the
+** record anymore.
+** Tests without expected values yet (`REPORT_STATUS_NO_GOLDEN`) count in
+** neither `nb_pass` nor `nb_fail`.
+**
+** `state` is `REPORT_STATE_RUNNING` while the tests are running and is set to
+** `REPORT_STATE_DONE` by `report_finish()`, once the last test completed and
+** its result was recorded. It is the last field written, both in EWRAM and in
+** SRAM, so a runner can stop the emulator as soon as it sees it.
+*/
+
+#define REPORT_ADDR             0x02038000
+#define REPORT_SRAM_ADDR        0x0E000000
+#define REPORT_SIZE             0x7300
+#define REPORT_LOG_SRAM_ADDR    (REPORT_SRAM_ADDR + REPORT_SIZE)
+#define REPORT_LOG_SIZE         0xC00
+
+#define REPORT_MAGIC            0x52534448  // "HDSR"
+#define REPORT_VERSION          3
+
+#define REPORT_STATE_RUNNING    0x4E4E5552  // "RUNN"
+#define REPORT_STATE_DONE       0x454E4F44  // "DONE"
+
+#define REPORT_MAX_SAMPLES      16
+
+#define REPORT_ENTRY_16BIT      0x01
+
+enum report_suite {
+    REPORT_SUITE_BIOS_OPENBUS       = 1,
+    REPORT_SUITE_DMA_LATCH          = 2,
+    REPORT_SUITE_DMA_START_DELAY    = 3,
+    REPORT_SUITE_TIMER_BASIC        = 4,
+    REPORT_SUITE_IDLE_LOOPS         = 5,
+    REPORT_SUITE_SELF_MODIFYING     = 6,
+    REPORT_SUITE_TIMER_CASCADE      = 7,
+    REPORT_SUITE_HALT               = 8,
+    REPORT_SUITE_SCHEDULER_LOAD     = 9,
+    REPORT_SUITE_DMA_TIMING         = 10,
+    REPORT_SUITE_DMA_COPY           = 11,
+    REPORT_SUITE_OPENBUS            = 12,
+    REPORT_SUITE_MEMORY             = 13,
+    REPORT_SUITE_BIOS_SWI           = 14,
+    REPORT_SUITE_IRQ_LATENCY        = 15,
+    REPORT_SUITE_SOUND_FIFO         = 16,
+};
+
+enum report_status {
+    REPORT_STATUS_FAIL              = 0,
+    REPORT_STATUS_PASS              = 1,
+    REPORT_STATUS_RECORDED          = 2,
+    REPORT_STATUS_NO_GOLDEN         = 3,
+};
+
+/*
+** Record mode.
+**
+** ROMs built with `RECORD=1` ignore their expectations: every test is marked
+** as `REPORT_STATUS_RECORDED` and reported as successful, so it runs all the
+** way through, and the raw samples are dumped on screen once all tests ran.
+** `nb_pass` and `nb_fail` still tell how the samples compare to the current
+** expectations.
+**
+** `tools/goldens.py` turns the record into the expected-value tables.
+*/
+#ifndef RECORD
+# define RECORD                 0
+#endif
+
+#if RECORD
+# define REPORT_PASS_STR        "REC"
+#else
+# define REPORT_PASS_STR        "PASS"
+#endif
+
+struct report_header {
+    u32 magic;
+    u16 version;
+    u16 entries_size;
+    u16 nb_tests;
+    u16 nb_entries;
+    u16 nb_pass;
+    u16 nb_fail;
+    u32 state;
+};
+
+static_assert(sizeof(struct report_header) == 0x14);
+
+struct report_entry {
+    u8 suite;
+    u8 status;
+    u16 test;
+    u16 variant;
+    u8 nb_samples;
+    u8 flags;
+    u8 samples[];   // Measured, then expected
+};
+
+static_assert(sizeof(struct report_entry) == 0x8);
+
+/* source/common/report.c */
+void report_init(void);
+void report_begin(enum report_suite suite, u16 test, u16 variant);
+void report_sample(u32 measured, u32 expected);
+void report_unknown(void);
+bool report_end(void);
+void report_finish(void);
+struct report_entry const *report_first(void);
+struct report_entry const *report_next(struct report_entry const *entry);
+u32 report_measured(struct report_entry const *entry, size_t i);
+
+/* source/common/record.c */
+void record_dump(void);
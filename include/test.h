@@ -0,0 +1,125 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#pragma once
+
+#include <gba_types.h>
+#include "report.h"
+
+/*
+** Test registry.
+**
+** Tests register themselves with `REGISTER_TEST()`, which places a `struct test`
+** in the `hades_tests` linker section. `run` is called with that entry, so a
+** single function can serve several tests through `data`. The linker gathers the entries of every
+** object linked in a ROM in one table, bounded by `__start_hades_tests` and
+** `__stop_hades_tests`, that `main()` walks in order.
+**
+** Each ROM is made of the objects of one or more suites and of the common
+** objects, so adding a suite to a ROM only means linking it in.
+**
+** The table keeps the declaration order within a file because the sources are
+** built with `-fno-toplevel-reorder`, and the link order across files.
+*/
+
+#define REG_WAITCNT         *(vu32*)(REG_BASE + 0x204)
+#define WAITCNT_WS0_SHIFT   2
+#define WAITCNT_WS1_SHIFT   5
+#define WAITCNT_WS2_SHIFT   8
+#define WAITCNT_WS_MASK     0x7     // N (2 bits) and S (1 bit) fields of a waitstate
+#define WAITCNT_PREFETCH    (1 << 14)
+
+/*
+** Where the code of a test runs from, and with which settings.
+**
+** `TEST_KIND_ROM_*` run from the ROM's first mirror (WS0, 0x08000000),
+** `TEST_KIND_ROM_WS1_*` and `TEST_KIND_ROM_WS2_*` from the two others
+** (0x0A000000 and 0x0C000000).
+*/
+enum test_kind {
+    TEST_KIND_IWRAM,
+    TEST_KIND_EWRAM,
+    TEST_KIND_ROM_WITH_PREFETCH,
+    TEST_KIND_ROM_WITHOUT_PREFETCH,
+    TEST_KIND_ROM_WS1_WITH_PREFETCH,
+    TEST_KIND_ROM_WS1_WITHOUT_PREFETCH,
+    TEST_KIND_ROM_WS2_WITH_PREFETCH,
+    TEST_KIND_ROM_WS2_WITHOUT_PREFETCH,
+
+    TEST_KIND_MAX,
+};
+
+struct suite {
+    enum report_suite id;
+    char const *name;
+    char const *description;
+};
+
+struct test {
+    struct suite const *suite;
+    u16 idx;
+    u16 kind;
+    void (*run)(struct test const *test);
+    void const *data;
+};
+
+#define NEW_SUITE(_var, _id, _name, _description)                           \
+    static struct suite const _var = {                                      \
+        .id = (_id),                                                        \
+        .name = (_name),                                                    \
+        .description = (_description),                                      \
+    }
+
+#define TEST_CONCAT_(_a, _b)    _a##_b
+#define TEST_CONCAT(_a, _b)     TEST_CONCAT_(_a, _b)
+
+#define REGISTER_TEST(_suite, _idx, _kind, _run, _data)                     \
+    __attribute__((used, section("hades_tests")))                           \
+    static struct test const TEST_CONCAT(test_entry_, __COUNTER__) = {      \
+        .suite = &(_suite),                                                 \
+        .idx = (_idx),                                                      \
+        .kind = (_kind),                                                    \
+        .run = (_run),                                                      \
+        .data = (_data),                                                    \
+    }
+
+extern struct test const __start_hades_tests[];
+extern struct test const __stop_hades_tests[];
+
+/*
+** Test selection.
+**
+** A runner can restrict which tests run by writing a `struct test_selection`
+** in the cartridge's SRAM, at `TEST_SELECTION_SRAM_ADDR`, before booting the
+** ROM. It is read once at boot and left untouched.
+**
+** A test runs if its suite is in `suites`, its kind is in `kinds` and, unless
+** `nb_tests` is 0, it is listed in `tests`. An empty mask selects everything.
+**
+** Without a valid magic, every test runs.
+*/
+
+#define TEST_SELECTION_SRAM_ADDR    0x0E007F00
+#define TEST_SELECTION_MAGIC        0x4C534448  // "HDSL"
+#define TEST_SELECTION_MAX          32
+
+struct test_selection {
+    u32 magic;
+    u32 suites;
+    u32 kinds;
+    u16 nb_tests;
+    u16 _reserved;
+    struct {
+        u8 suite;
+        u8 _reserved;
+        u16 idx;
+    } tests[TEST_SELECTION_MAX];
+};
+
+static_assert(sizeof(struct test_selection) == 0x90);
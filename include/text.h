@@ -0,0 +1,38 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#pragma once
+
+#include <gba_types.h>
+
+/*
+** Minimal text renderer.
+**
+** Characters are drawn on BG0, in mode 0, using a built-in 8x8 font expanded
+** to 4bpp tiles at boot. The map is 32 lines high but only 20 are visible:
+** once the screen is full, BG0 is scrolled vertically instead of moving the
+** map around.
+*/
+
+#define TEXT_WIDTH              30
+#define TEXT_HEIGHT             20
+#define TEXT_MAP_HEIGHT         32
+
+#define TEXT_FONT_FIRST         ' '
+#define TEXT_FONT_LEN           ('~' - ' ' + 1)
+
+#define TEXT_CHAR_BASE          0
+#define TEXT_SCREEN_BASE        31
+
+/* source/common/font.c */
+extern u8 const text_font[TEXT_FONT_LEN][8];
+
+/* source/common/text.c */
+void text_init(void);
+void text_putc(char c);
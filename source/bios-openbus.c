@@ -7,65 +7,358 @@
 **
 \******************************************************************************/
 
-#include <gba_console.h>
 #include <gba_interrupt.h>
 #include <gba_systemcalls.h>
-#include <stdio.h>
+#include <gba_timers.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
 
-IWRAM_CODE
-int
-main(
+NEW_SUITE(bios_openbus, REPORT_SUITE_BIOS_OPENBUS, "BIOS Tests", "Open Bus Unaligned Access");
+
+#define BIOS_READS          12
+
+/*
+** The opcode the BIOS fetched last, which reads from the BIOS return once the
+** CPU left it, depending on the path that left it.
+*/
+#define BIOS_BUS_SWI        0xE3A02004  // [0x188 + 8], returning from a SWI
+#define BIOS_BUS_IRQ        0xE25EF004  // [0x134 + 8], calling an IRQ handler
+#define BIOS_BUS_IRQ_RETURN 0xE55EC002  // [0x13C + 8], returning from it
+#define BIOS_BUS_RESET      0xE129F000  // [0x0DC + 8], leaving SoftReset
+
+/*
+** Read the BIOS right after a SWI returned, at all widths and alignments.
+*/
+#define NEW_TEST(_idx, _type, _addr, _expected) \
+    IWRAM_CODE \
+    static \
+    void \
+    test_##_idx(struct test const *test __unused) \
+    { \
+        u32 value; \
+        \
+        VBlankIntrWait(); \
+        \
+        value = *(_type *)(_addr); \
+        \
+        report_begin(REPORT_SUITE_BIOS_OPENBUS, (_idx), TEST_KIND_IWRAM); \
+        report_sample(value, (_expected)); \
+        \
+        if (report_end()) { \
+            log_dec((_idx), 2); \
+            log_puts(": " REPORT_PASS_STR "\n"); \
+        } else { \
+            log_dec((_idx), 2); \
+            log_puts(": FAIL "); \
+            log_hex((_expected), 8); \
+            log_puts(" != "); \
+            log_hex(value, 8); \
+            log_putc('\n'); \
+        } \
+    } \
+    \
+    REGISTER_TEST(bios_openbus, (_idx), TEST_KIND_IWRAM, test_##_idx, NULL);
+
+NEW_TEST(1,  vu32, 0x0, 0xe3a02004)
+NEW_TEST(2,  vu16, 0x0, 0x00002004)
+NEW_TEST(3,  vu8,  0x0, 0x00000004)
+NEW_TEST(4,  vu32, 0x1, 0x04e3a020)
+NEW_TEST(5,  vu16, 0x1, 0x00000020)
+NEW_TEST(6,  vu8,  0x1, 0x00000020)
+NEW_TEST(7,  vu32, 0x2, 0x2004e3a0)
+NEW_TEST(8,  vu16, 0x2, 0x0000e3a0)
+NEW_TEST(9,  vu8,  0x2, 0x000000a0)
+NEW_TEST(10, vu32, 0x3, 0xa02004e3)
+NEW_TEST(11, vu16, 0x3, 0x000000e3)
+NEW_TEST(12, vu8,  0x3, 0x000000e3)
+
+/*
+** The same reads as tests 1 to 12, after each path leaving the BIOS.
+*/
+
+typedef void (*bios_path_t)(u32 *values);
+
+struct bios_path {
+    char const *name;
+    bios_path_t run;
+    u32 bus;
+};
+
+static u32 bios_irq_values[BIOS_READS];
+static u32 volatile bios_irq_done;
+
+/*
+** SoftReset() clears 0x03007E00-0x03007FFF, where the stacks and the IRQ
+** vector are, then jumps to 0x02000000 if the byte at 0x03007FFA isn't 0.
+**
+** `bios_soft_reset()` saves that area and its stack pointer before calling it,
+** and `bios_soft_reset_entry`, copied to 0x02000000, restores them and returns
+** to its caller as if the SWI did. No BIOS code runs in between.
+*/
+static u32 bios_soft_reset_ctx[1 + 0x200 / sizeof(u32)];
+
+__asm__(
+    ".pushsection .iwram, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".balign 4\n"
+    ".arm\n"
+    "bios_soft_reset:\n"
+    "push {r4-r11, lr}\n"
+
+    // Save the stack pointer and 0x03007E00-0x03007FFF
+    "ldr r0, =bios_soft_reset_ctx\n"
+    "str sp, [r0], #4\n"
+    "ldr r1, =#0x03007E00\n"
+    "mov r2, #0x80\n"
+    "1:\n"
+    "ldr r3, [r1], #4\n"
+    "str r3, [r0], #4\n"
+    "subs r2, r2, #1\n"
+    "bne 1b\n"
+
+    // Return to 0x02000000
+    "ldr r1, =#0x03007FFA\n"
+    "mov r2, #1\n"
+    "strb r2, [r1]\n"
+    "swi #0x000000\n"
+    ".ltorg\n"
+
+    // Copied to 0x02000000, so it only uses its own literals
+    "bios_soft_reset_entry:\n"
+    "ldr r0, 2f\n"
+    "ldr sp, [r0], #4\n"
+    "ldr r1, 3f\n"
+    "mov r2, #0x80\n"
+    "1:\n"
+    "ldr r3, [r0], #4\n"
+    "str r3, [r1], #4\n"
+    "subs r2, r2, #1\n"
+    "bne 1b\n"
+
+    "pop {r4-r11, lr}\n"
+    "bx lr\n"
+    "2: .word bios_soft_reset_ctx\n"
+    "3: .word 0x03007E00\n"
+    "bios_soft_reset_entry_end:\n"
+    ".popsection\n"
+);
+
+__attribute__((long_call))
+void bios_soft_reset(void);
+
+extern u32 const bios_soft_reset_entry[];
+extern u32 const bios_soft_reset_entry_end[];
+
+/*
+** Read the BIOS at all widths and alignments, in the order of tests 1 to 12.
+*/
+static
+void
+bios_read(
+    u32 *values
+) {
+    values[0] = *(vu32 *)(0x0);
+    values[1] = *(vu16 *)(0x0);
+    values[2] = *(vu8 *)(0x0);
+    values[3] = *(vu32 *)(0x1);
+    values[4] = *(vu16 *)(0x1);
+    values[5] = *(vu8 *)(0x1);
+    values[6] = *(vu32 *)(0x2);
+    values[7] = *(vu16 *)(0x2);
+    values[8] = *(vu8 *)(0x2);
+    values[9] = *(vu32 *)(0x3);
+    values[10] = *(vu16 *)(0x3);
+    values[11] = *(vu8 *)(0x3);
+}
+
+static
+u32
+bios_ror(
+    u32 value,
+    u32 shift
+) {
+    return shift ? (value >> shift) | (value << (32 - shift)) : value;
+}
+
+/*
+** Return the value of read `i` of `bios_read()`, given the value of the bus.
+*/
+static
+u32
+bios_expected(
+    u32 bus,
+    u32 i
+) {
+    u32 align;
+    u32 half;
+
+    align = i / 3;
+
+    // 16-bit reads are rotated too, then truncated by their `vu16`
+    switch (i % 3) {
+        case 0:     return bios_ror(bus, 8 * align);
+        case 1: {
+            half = (bus >> (8 * (align & 2))) & 0xFFFF;
+            return bios_ror(half, 8 * (align & 1)) & 0xFFFF;
+        }
+        default:    return (bus >> (8 * align)) & 0xFF;
+    }
+}
+
+static
+void
+bios_path_swi(
+    u32 *values
+) {
+    Sqrt(0x100);
+    bios_read(values);
+}
+
+static
+void
+bios_irq_handler(
     void
 ) {
-    u16 nb_test_pass;
-    u16 nb_test_fail;
-
-    irqInit();
-    consoleDemoInit();
-
-    printf("BIOS Tests\n");
-    printf("  Open Bus Unaligned Access\n\n");
-
-    irqEnable(IRQ_VBLANK);
-    VBlankIntrWait();
-
-    u32 values[12][2] = {
-        { 0xe3a02004, *(vu32 *)0x0 },
-        { 0x00002004, *(vu16 *)0x0 },
-        { 0x00000004, *(vu8 *)0x0 },
-        { 0x04e3a020, *(vu32 *)0x1 },
-        { 0x00000020, *(vu16 *)0x1 },
-        { 0x00000020, *(vu8 *)0x1 },
-        { 0x2004e3a0, *(vu32 *)0x2 },
-        { 0x0000e3a0, *(vu16 *)0x2 },
-        { 0x000000a0, *(vu8 *)0x2 },
-        { 0xa02004e3, *(vu32 *)0x3 },
-        { 0x000000e3, *(vu16 *)0x3 },
-        { 0x000000e3, *(vu8 *)0x3 },
-    };
-
-    nb_test_pass = 0;
-    nb_test_fail = 0;
-    for (int i = 0; i < 12; ++i) {
-        bool success;
-
-        success = (values[i][0] == values[i][1]);
-
-        if (success) {
-            ++nb_test_pass;
-            printf("%02i: PASS\n", i + 1);
-        } else {
-            ++nb_test_fail;
-            printf("%02i: FAIL %08lX != %08lX\n", i + 1, values[i][0], values[i][1]);
+    bios_read(bios_irq_values);
+    REG_TM0CNT = 0;
+    bios_irq_done = true;
+}
+
+/*
+** Run `bios_irq_handler()` on Timer 0's overflow, and return once it did.
+*/
+static
+void
+bios_irq(
+    void
+) {
+    bios_irq_done = false;
+    irqSet(IRQ_TIMER0, bios_irq_handler);
+    REG_IE = IRQ_TIMER0;
+    REG_TM0CNT = 0xFF00 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_IME = 1;
+
+    while (!bios_irq_done);
+}
+
+static
+void
+bios_path_irq(
+    u32 *values
+) {
+    u32 i;
+
+    bios_irq();
+    for (i = 0; i < BIOS_READS; ++i) {
+        values[i] = bios_irq_values[i];
+    }
+}
+
+static
+void
+bios_path_irq_return(
+    u32 *values
+) {
+    bios_irq();
+    bios_read(values);
+}
+
+static
+void
+bios_path_register_ram_reset(
+    u32 *values
+) {
+    RegisterRamReset(RESET_SIO);
+    bios_read(values);
+}
+
+/*
+** Run SoftReset() with `bios_soft_reset_entry` copied to 0x02000000, whatever
+** was there being restored afterwards.
+*/
+static
+void
+bios_path_soft_reset(
+    u32 *values
+) {
+    u32 saved[0x40 / sizeof(u32)];      // Larger than `bios_soft_reset_entry`
+    size_t size;
+    u32 i;
+
+    size = bios_soft_reset_entry_end - bios_soft_reset_entry;
+
+    for (i = 0; i < size; ++i) {
+        saved[i] = ((vu32 *)0x02000000)[i];
+        ((vu32 *)0x02000000)[i] = bios_soft_reset_entry[i];
+    }
+
+    bios_soft_reset();
+    bios_read(values);
+
+    for (i = 0; i < size; ++i) {
+        ((vu32 *)0x02000000)[i] = saved[i];
+    }
+}
+
+static
+void
+bios_path_run(
+    struct test const *test
+) {
+    struct bios_path const *path;
+    u32 values[BIOS_READS];
+    u32 expected[BIOS_READS];
+    u32 failed;
+    u16 ime;
+    u16 ie;
+    u32 i;
+
+    path = test->data;
+
+    ime = REG_IME;
+    ie = REG_IE;
+    REG_IME = 0;
+    path->run(values);
+    REG_IME = 0;
+    irqSet(IRQ_TIMER0, NULL);
+    REG_IE = ie;
+    REG_IME = ime;
+
+    report_begin(REPORT_SUITE_BIOS_OPENBUS, test->idx, TEST_KIND_IWRAM);
+    failed = BIOS_READS;
+    for (i = 0; i < BIOS_READS; ++i) {
+        expected[i] = bios_expected(path->bus, i);
+        report_sample(values[i], expected[i]);
+        if (values[i] != expected[i] && failed == BIOS_READS) {
+            failed = i;
         }
     }
 
-    printf("\n");
-    printf("Total: %u/%u\n", nb_test_pass, nb_test_pass + nb_test_fail);
+    log_dec(test->idx, 2);
+    log_putc(' ');
+    log_puts(path->name);
 
-    while (true) {
-        VBlankIntrWait();
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR "\n");
+        return;
     }
 
-    return (0);
+    log_puts(": FAIL +");
+    log_dec(failed / 3, 0);
+    log_puts((failed % 3) ? ((failed % 3 == 1) ? " 16 " : " 8 ") : " 32 ");
+    log_hex(expected[failed], 8);
+    log_puts(" != ");
+    log_hex(values[failed], 8);
+    log_putc('\n');
 }
+
+#define NEW_PATH_TEST(_idx, _name, _run, _bus)                              \
+    static struct bios_path const path_##_idx = { _name, _run, _bus };      \
+    REGISTER_TEST(bios_openbus, (_idx), TEST_KIND_IWRAM, bios_path_run, &path_##_idx);
+
+NEW_PATH_TEST(13, "SWI",                bios_path_swi,                  BIOS_BUS_SWI)
+NEW_PATH_TEST(14, "IRQ",                bios_path_irq,                  BIOS_BUS_IRQ)
+NEW_PATH_TEST(15, "IRQ RETURN",         bios_path_irq_return,           BIOS_BUS_IRQ_RETURN)
+NEW_PATH_TEST(16, "REGISTERRAMRESET",   bios_path_register_ram_reset,   BIOS_BUS_SWI)
+NEW_PATH_TEST(17, "SOFTRESET",          bios_path_soft_reset,           BIOS_BUS_RESET)
@@ -0,0 +1,624 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** How many cycles the BIOS' SWIs take, the tables emulators running them in
+** C instead of the BIOS' code need to charge the right time.
+**
+** Each SWI is issued from a stub that starts Timer 0 and Timer 1, cascaded in
+** a 32-bit counter, right before the `swi` and stops them right after it. The
+** stubs run from IWRAM, EWRAM and ROM, with and without prefetch, each kind
+** being registered as its own test.
+**
+** Every test first runs a stub issuing a `nop` instead, and reports the number
+** of cycles the SWI took over it, for 4 inputs or sizes. The data the SWIs work
+** on is in EWRAM, except for the tests marked IWRAM.
+**
+** Not measured on hardware yet: build with `RECORD=1` and turn the record into
+** the rows of `expected` with `tools/goldens.py`. Until then they are reported
+** without golden, but still fail if they cross the bounds of their test.
+**
+** Those bounds only count what can be derived from the bus: the SWI's entry
+** and return take at least 20 cycles, and none of the math SWIs, looping at
+** most 32 times over a few instructions, comes near 1000. The other SWIs run
+** from the BIOS, so the stub's kind doesn't change what each unit adds, which
+** is at least the cost of its reads and writes to the data (6 cycles for a
+** word of EWRAM, 3 for a halfword or a byte, 1 for IWRAM). CpuSet may add up
+** to 16 cycles a unit for its loop, and CpuFastSet 4, moving 8 words at once.
+*/
+
+#include <gba_interrupt.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(bios_swi, REPORT_SUITE_BIOS_SWI, "BIOS Tests", "SWI Cycle Costs");
+
+#define SWI_SAMPLES         4
+#define SWI_MAX_SIZE        0x800   // Bytes the SWIs read or write, at most
+#define SWI_STUB_SIZE       0x80
+#define SWI_TESTS           15
+
+// Mode bits of CpuSet and CpuFastSet
+#define SWI_SET_FILL        (1 << 24)
+#define SWI_SET_32BIT       (1 << 26)
+
+// Bounds of the math SWIs, in cycles
+#define SWI_MATH_MIN        20
+#define SWI_MATH_MAX        1000
+
+// Sizes of the copies and of the decompressed data, in bytes
+static u32 const swi_sizes[SWI_SAMPLES] = { 0x20, 0x80, 0x200, 0x800 };
+
+/*
+** The stubs, in the order of `enum swi_stub`.
+*/
+enum swi_stub {
+    SWI_STUB_NONE,
+    SWI_STUB_DIV,
+    SWI_STUB_SQRT,
+    SWI_STUB_ARCTAN2,
+    SWI_STUB_CPUSET,
+    SWI_STUB_CPUFASTSET,
+    SWI_STUB_BGAFFINESET,
+    SWI_STUB_LZ77,
+    SWI_STUB_HUFF,
+    SWI_STUB_RL,
+
+    SWI_STUB_MAX,
+};
+
+/*
+** The arguments of a stub, and the value it read.
+*/
+struct swi_run {
+    u32 regs[4];        // r0 to r3 when the SWI is issued
+    u32 elapsed;        // Timer 1 and Timer 0 once it returned
+};
+
+static_assert(offsetof(struct swi_run, elapsed) == 0x10);
+
+/*
+** Each stub is `SWI_STUB_SIZE` bytes long and only uses absolute addressing,
+** so they can be copied together anywhere.
+**
+** Timer 0 is stopped before the timers are read, so Timer 1 can't tick
+** between the two reads.
+*/
+__asm__(
+    ".pushsection .text.bios_swi, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".arm\n"
+
+    ".macro swi_stub op:vararg\n"
+    ".balign 0x80\n"
+    "push {r4-r7, lr}\n"
+    "mov r7, r0\n"
+
+    // Set r6 to REG_TM0CNT, stop both timers and set their reload value to 0
+    "mov r6, #0x04000000\n"
+    "orr r6, r6, #0x100\n"
+    "mov r4, #0\n"
+    "str r4, [r6]\n"
+    "str r4, [r6, #0x4]\n"
+
+    // Start Timer 1, cascaded, then Timer 0, and issue the SWI
+    "mov r4, #0x00840000\n"
+    "str r4, [r6, #0x4]\n"
+    "ldm r7, {r0-r3}\n"
+    "mov r4, #0x00800000\n"
+    "str r4, [r6]\n"
+    "\\op\n"
+
+    // Stop Timer 0, read both timers, and stop Timer 1
+    "mov r4, #0\n"
+    "str r4, [r6]\n"
+    "ldrh r4, [r6]\n"
+    "ldrh r5, [r6, #0x4]\n"
+    "orr r4, r4, r5, lsl #16\n"
+    "str r4, [r7, #0x10]\n"
+    "mov r4, #0\n"
+    "str r4, [r6, #0x4]\n"
+
+    "pop {r4-r7, lr}\n"
+    "bx lr\n"
+    ".endm\n"
+
+    ".balign 0x80\n"
+    "swi_stubs:\n"
+    "swi_stub nop\n"
+    "swi_stub swi #0x060000\n"      // Div
+    "swi_stub swi #0x080000\n"      // Sqrt
+    "swi_stub swi #0x0A0000\n"      // ArcTan2
+    "swi_stub swi #0x0B0000\n"      // CpuSet
+    "swi_stub swi #0x0C0000\n"      // CpuFastSet
+    "swi_stub swi #0x0E0000\n"      // BgAffineSet
+    "swi_stub swi #0x110000\n"      // LZ77UnCompWram
+    "swi_stub swi #0x130000\n"      // HuffUnComp
+    "swi_stub swi #0x140000\n"      // RLUnCompWram
+    ".balign 0x80\n"
+    "swi_stubs_end:\n"
+
+    ".popsection\n"
+);
+
+extern u8 const swi_stubs[];
+extern u8 const swi_stubs_end[];
+
+typedef void (*swi_stub_t)(struct swi_run *run);
+
+static u32 swi_iwram_stubs[SWI_STUB_MAX * SWI_STUB_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 swi_ewram_stubs[SWI_STUB_MAX * SWI_STUB_SIZE / sizeof(u32)];
+
+static u32 swi_iwram_src[SWI_MAX_SIZE / sizeof(u32)];
+static u32 swi_iwram_dst[SWI_MAX_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 swi_ewram_src[SWI_MAX_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 swi_ewram_dst[SWI_MAX_SIZE / sizeof(u32)];
+
+struct swi_test;
+
+/*
+** Fill the registers of sample `sample` of `test`, and the data they point
+** to.
+*/
+typedef void (*swi_args_t)(struct swi_test const *test, u32 sample, u32 *regs);
+
+struct swi_test {
+    char const *name;
+    enum swi_stub stub;
+    swi_args_t args;
+    u32 inputs[SWI_SAMPLES][2]; // r0 and r1 of the math SWIs
+    u32 mode;                   // Mode bits of CpuSet and CpuFastSet
+    u32 unit;                   // Bytes of a unit, 0 for the math SWIs
+    u32 min;                    // Cycles a unit adds at least, or a math SWI takes
+    u32 max;                    // Cycles a unit adds at most, 0 if unbounded
+    bool iwram;                 // Whether the data is in IWRAM
+};
+
+/*
+** Cycles each SWI took over a `nop`, for each kind.
+*/
+static u32 const expected[SWI_TESTS][TEST_KIND_MAX][SWI_SAMPLES] = {
+    { { 0 } },
+};
+
+static char const * const kind_names[TEST_KIND_MAX] = {
+    [TEST_KIND_IWRAM]                   = "IWRAM",
+    [TEST_KIND_EWRAM]                   = "EWRAM",
+    [TEST_KIND_ROM_WITH_PREFETCH]       = "ROM PREFETCH",
+    [TEST_KIND_ROM_WITHOUT_PREFETCH]    = "ROM",
+};
+
+static
+void
+swi_args_math(
+    struct swi_test const *test,
+    u32 sample,
+    u32 *regs
+) {
+    regs[0] = test->inputs[sample][0];
+    regs[1] = test->inputs[sample][1];
+}
+
+static
+void
+swi_args_copy(
+    struct swi_test const *test,
+    u32 sample,
+    u32 *regs
+) {
+    u32 i;
+
+    for (i = 0; i < SWI_MAX_SIZE / sizeof(u32); ++i) {
+        swi_ewram_src[i] = 0x01010101 * i;
+        swi_iwram_src[i] = 0x01010101 * i;
+    }
+
+    regs[0] = (u32)(test->iwram ? swi_iwram_src : swi_ewram_src);
+    regs[1] = (u32)(test->iwram ? swi_iwram_dst : swi_ewram_dst);
+    regs[2] = (swi_sizes[sample] / test->unit) | test->mode;
+}
+
+/*
+** LZ77 data made of groups of 4 literals and 4 references to the 8 bytes
+** before them, 18 bytes long at most.
+*/
+static
+void
+swi_args_lz77(
+    struct swi_test const *test __unused,
+    u32 sample,
+    u32 *regs
+) {
+    u8 *out;
+    u8 *flags;
+    u32 remaining;
+    u32 written;
+    u32 len;
+    u32 i;
+
+    out = (u8 *)swi_ewram_src;
+    remaining = swi_sizes[sample];
+    written = 0;
+
+    *out++ = 0x10;
+    *out++ = remaining;
+    *out++ = remaining >> 8;
+    *out++ = remaining >> 16;
+
+    while (remaining) {
+        flags = out++;
+        *flags = 0;
+
+        for (i = 0; i < 8 && remaining; ++i) {
+            len = remaining < 18 ? remaining : 18;
+            if (i < 4 || written < 8 || len < 3) {
+                *out++ = 0x5A ^ written;
+                len = 1;
+            } else {
+                *flags |= 0x80 >> i;
+                *out++ = (len - 3) << 4;
+                *out++ = 8 - 1;
+            }
+            remaining -= len;
+            written += len;
+        }
+    }
+
+    regs[0] = (u32)swi_ewram_src;
+    regs[1] = (u32)swi_ewram_dst;
+}
+
+/*
+** RL data alternating 8 literals and a run of 24 bytes.
+*/
+static
+void
+swi_args_rl(
+    struct swi_test const *test __unused,
+    u32 sample,
+    u32 *regs
+) {
+    u8 *out;
+    u32 remaining;
+    u32 len;
+    u32 i;
+
+    out = (u8 *)swi_ewram_src;
+    remaining = swi_sizes[sample];
+
+    *out++ = 0x30;
+    *out++ = remaining;
+    *out++ = remaining >> 8;
+    *out++ = remaining >> 16;
+
+    while (remaining) {
+        len = remaining < 8 ? remaining : 8;
+        *out++ = len - 1;
+        for (i = 0; i < len; ++i) {
+            *out++ = 0xA5 ^ (remaining - i);
+        }
+        remaining -= len;
+
+        len = remaining < 24 ? remaining : 24;
+        if (len >= 3) {
+            *out++ = 0x80 | (len - 3);
+            *out++ = remaining;
+            remaining -= len;
+        }
+    }
+
+    regs[0] = (u32)swi_ewram_src;
+    regs[1] = (u32)swi_ewram_dst;
+}
+
+/*
+** Huffman data of 8-bit symbols, with a tree of two leaves, so each byte is a
+** single bit.
+*/
+static
+void
+swi_args_huff(
+    struct swi_test const *test __unused,
+    u32 sample,
+    u32 *regs
+) {
+    u8 *out;
+    u32 size;
+    u32 i;
+
+    out = (u8 *)swi_ewram_src;
+    size = swi_sizes[sample];
+
+    *out++ = 0x28;
+    *out++ = size;
+    *out++ = size >> 8;
+    *out++ = size >> 16;
+
+    // Tree: its size, the root and the two leaves
+    *out++ = 1;
+    *out++ = 0xC0;
+    *out++ = 'A';
+    *out++ = 'B';
+
+    for (i = 0; i < size / 32; ++i) {
+        swi_ewram_src[2 + i] = 0x5A3C96E1 ^ (i * 0x01000193);
+    }
+
+    regs[0] = (u32)swi_ewram_src;
+    regs[1] = (u32)swi_ewram_dst;
+}
+
+/*
+** One BgAffineSet source per 32 bytes of the sample's size, with different
+** angles and scales.
+*/
+static
+void
+swi_args_affine(
+    struct swi_test const *test __unused,
+    u32 sample,
+    u32 *regs
+) {
+    u32 count;
+    u16 *src;
+    u32 i;
+
+    count = swi_sizes[sample] / 0x20;
+    src = (u16 *)swi_ewram_src;
+
+    for (i = 0; i < count; ++i, src += 10) {
+        ((u32 *)src)[0] = (i * 0x100) << 8;     // Center of the BG, 20.8
+        ((u32 *)src)[1] = (i * 0x80) << 8;
+        src[4] = 120;                           // Center of the screen
+        src[5] = 80;
+        src[6] = 0x100 + i * 0x10;              // Scales, 8.8
+        src[7] = 0x100 - i * 0x4;
+        src[8] = i * 0x0D00;                    // Angle, upper byte only
+    }
+
+    regs[0] = (u32)swi_ewram_src;
+    regs[1] = (u32)swi_ewram_dst;
+    regs[2] = count;
+}
+
+/*
+** Copy the stubs for `kind` and return where they begin.
+*/
+static
+u8 const *
+swi_place(
+    u16 kind
+) {
+    u32 const *src;
+    u32 *dst;
+    u32 i;
+
+    switch (kind) {
+        case TEST_KIND_IWRAM:   dst = swi_iwram_stubs; break;
+        case TEST_KIND_EWRAM:   dst = swi_ewram_stubs; break;
+        default:                return swi_stubs;
+    }
+
+    src = (u32 const *)swi_stubs;
+    for (i = 0; i < (u32)(swi_stubs_end - swi_stubs) / sizeof(u32); ++i) {
+        dst[i] = src[i];
+    }
+    return (u8 const *)dst;
+}
+
+static
+u32
+swi_time(
+    u8 const *stubs,
+    enum swi_stub stub,
+    u32 const *regs
+) {
+    struct swi_run run;
+    u32 i;
+
+    for (i = 0; i < 4; ++i) {
+        run.regs[i] = regs[i];
+    }
+    ((swi_stub_t)(stubs + stub * SWI_STUB_SIZE))(&run);
+    return run.elapsed;
+}
+
+/*
+** Check `measured` against the bounds of `test`. Return false and set `value`
+** and `bound` to the first one crossed.
+*/
+static
+bool
+swi_check_bounds(
+    struct swi_test const *test,
+    u32 const *measured,
+    u32 *value,
+    u32 *bound
+) {
+    u32 units;
+    u32 i;
+
+    for (i = 0; i < SWI_SAMPLES; ++i) {
+        if (test->unit) {
+            if (!i) {
+                continue;
+            }
+            units = (swi_sizes[i] - swi_sizes[i - 1]) / test->unit;
+            *value = measured[i] > measured[i - 1] ? measured[i] - measured[i - 1] : 0;
+        } else {
+            units = 1;
+            *value = measured[i];
+        }
+
+        if (*value < test->min * units) {
+            *bound = test->min * units;
+            return false;
+        }
+        if (test->max && *value > test->max * units) {
+            *bound = test->max * units;
+            return false;
+        }
+    }
+    return true;
+}
+
+static
+void
+swi_run_test(
+    struct test const *test
+) {
+    struct swi_test const *stest;
+    u32 const *golden;
+    u8 const *stubs;
+    u32 measured[SWI_SAMPLES];
+    u32 regs[4];
+    u32 baseline;
+    u32 waitcnt;
+    u32 failed;
+    u32 value;
+    u32 bound;
+    u16 ime;
+    bool bounded;
+    bool known;
+    u32 i;
+
+    stest = test->data;
+    golden = expected[test->idx - 1][test->kind];
+    stubs = swi_place(test->kind);
+
+    ime = REG_IME;
+    waitcnt = REG_WAITCNT;
+    REG_IME = 0;
+    REG_WAITCNT = (test->kind == TEST_KIND_ROM_WITH_PREFETCH) ? WAITCNT_PREFETCH : 0;
+
+    for (i = 0; i < 4; ++i) {
+        regs[i] = 0;
+    }
+    baseline = swi_time(stubs, SWI_STUB_NONE, regs);
+
+    for (i = 0; i < SWI_SAMPLES; ++i) {
+        regs[2] = 0;
+        stest->args(stest, i, regs);
+        measured[i] = swi_time(stubs, stest->stub, regs) - baseline;
+    }
+
+    REG_WAITCNT = waitcnt;
+    REG_IME = ime;
+
+    bounded = swi_check_bounds(stest, measured, &value, &bound);
+
+    report_begin(REPORT_SUITE_BIOS_SWI, test->idx, test->kind);
+    failed = SWI_SAMPLES;
+    known = false;
+    for (i = 0; i < SWI_SAMPLES; ++i) {
+        report_sample(measured[i], golden[i]);
+        known |= !!golden[i];
+        if (measured[i] != golden[i] && failed == SWI_SAMPLES) {
+            failed = i;
+        }
+    }
+
+    // A crossed bound is reported as an extra sample, and fails the test even without golden
+    if (!bounded) {
+        report_sample(value, bound);
+    } else if (!known) {
+        report_unknown();
+    }
+
+    log_puts(stest->name);
+    log_putc(' ');
+    log_puts(kind_names[test->kind]);
+
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR);
+        if (!RECORD && !known) {
+            log_puts(" (without golden)");
+        }
+        log_putc('\n');
+        return;
+    }
+
+    if (!bounded) {
+        log_puts(": FAIL BOUND 0x");
+        log_hex(value, 8);
+        log_puts(" / 0x");
+        log_hex(bound, 8);
+        log_putc('\n');
+        return;
+    }
+
+    log_puts(": FAIL #");
+    log_dec(failed, 0);
+    log_puts(" 0x");
+    log_hex(measured[failed], 8);
+    log_puts(" != 0x");
+    log_hex(golden[failed], 8);
+    log_putc('\n');
+}
+
+#define REGISTER_SWI_TEST(_idx, _kind)                                      \
+    REGISTER_TEST(bios_swi, _idx, _kind, swi_run_test, &test_##_idx)
+
+#define NEW_TEST(_idx, ...)                                                 \
+    static struct swi_test const test_##_idx = { __VA_ARGS__ };             \
+    static_assert((_idx) <= SWI_TESTS);                                     \
+    REGISTER_SWI_TEST(_idx, TEST_KIND_IWRAM);                               \
+    REGISTER_SWI_TEST(_idx, TEST_KIND_EWRAM);                               \
+    REGISTER_SWI_TEST(_idx, TEST_KIND_ROM_WITHOUT_PREFETCH);                \
+    REGISTER_SWI_TEST(_idx, TEST_KIND_ROM_WITH_PREFETCH);
+
+NEW_TEST(1,
+    .name = "DIV",
+    .stub = SWI_STUB_DIV,
+    .args = swi_args_math,
+    .inputs = { { 1, 1 }, { 1000, 7 }, { 0x7FFFFFFF, 3 }, { 0x7FFFFFFF, 0x10000 } },
+    .min = SWI_MATH_MIN,
+    .max = SWI_MATH_MAX,
+)
+
+NEW_TEST(2,
+    .name = "DIV SIGNS",
+    .stub = SWI_STUB_DIV,
+    .args = swi_args_math,
+    .inputs = { { 100, 7 }, { -100, 7 }, { 100, -7 }, { -100, -7 } },
+    .min = SWI_MATH_MIN,
+    .max = SWI_MATH_MAX,
+)
+
+NEW_TEST(3,
+    .name = "SQRT",
+    .stub = SWI_STUB_SQRT,
+    .args = swi_args_math,
+    .inputs = { { 0, 0 }, { 0x100, 0 }, { 0x12345, 0 }, { 0xFFFFFFFF, 0 } },
+    .min = SWI_MATH_MIN,
+    .max = SWI_MATH_MAX,
+)
+
+NEW_TEST(4,
+    .name = "ARCTAN2",
+    .stub = SWI_STUB_ARCTAN2,
+    .args = swi_args_math,
+    .inputs = { { 0x4000, 0 }, { 0x4000, 0x4000 }, { -0x4000, 0x2000 }, { 0x1000, -0x3000 } },
+    .min = SWI_MATH_MIN,
+    .max = SWI_MATH_MAX,
+)
+
+// CpuSet, CpuFastSet and BgAffineSet read and write each unit, the decompressors at least write it
+NEW_TEST(5,  .name = "CPUSET 16",            .stub = SWI_STUB_CPUSET,     .args = swi_args_copy, .unit = 2, .min = 6, .max = 22)
+NEW_TEST(6,  .name = "CPUSET 32",            .stub = SWI_STUB_CPUSET,     .args = swi_args_copy, .unit = 4, .min = 12, .max = 28, .mode = SWI_SET_32BIT)
+NEW_TEST(7,  .name = "CPUSET FILL",          .stub = SWI_STUB_CPUSET,     .args = swi_args_copy, .unit = 4, .min = 6, .max = 22, .mode = SWI_SET_32BIT | SWI_SET_FILL)
+NEW_TEST(8,  .name = "CPUFASTSET",           .stub = SWI_STUB_CPUFASTSET, .args = swi_args_copy, .unit = 4, .min = 12, .max = 16)
+NEW_TEST(9,  .name = "CPUFASTSET FILL",      .stub = SWI_STUB_CPUFASTSET, .args = swi_args_copy, .unit = 4, .min = 6, .max = 10, .mode = SWI_SET_FILL)
+NEW_TEST(10, .name = "CPUSET 32 IWRAM",      .stub = SWI_STUB_CPUSET,     .args = swi_args_copy, .unit = 4, .min = 2, .max = 18, .mode = SWI_SET_32BIT, .iwram = true)
+NEW_TEST(11, .name = "CPUFASTSET IWRAM",     .stub = SWI_STUB_CPUFASTSET, .args = swi_args_copy, .unit = 4, .min = 2, .max = 6, .iwram = true)
+NEW_TEST(12, .name = "LZ77UNCOMPWRAM",       .stub = SWI_STUB_LZ77,       .args = swi_args_lz77, .unit = 1, .min = 3)
+NEW_TEST(13, .name = "RLUNCOMPWRAM",         .stub = SWI_STUB_RL,         .args = swi_args_rl, .unit = 1, .min = 3)
+NEW_TEST(14, .name = "HUFFUNCOMP",           .stub = SWI_STUB_HUFF,       .args = swi_args_huff, .unit = 4, .min = 6)
+NEW_TEST(15, .name = "BGAFFINESET",          .stub = SWI_STUB_BGAFFINESET, .args = swi_args_affine, .unit = 32, .min = 51)
@@ -0,0 +1,266 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <string.h>
+#include "harness.h"
+#include "log.h"
+#include "report.h"
+
+static char const * const kind_names[TEST_KIND_MAX] = {
+    [TEST_KIND_IWRAM]                       = "IWRAM",
+    [TEST_KIND_EWRAM]                       = "EWRAM",
+    [TEST_KIND_ROM_WITH_PREFETCH]           = "ROM P",
+    [TEST_KIND_ROM_WITHOUT_PREFETCH]        = "ROM  ",
+    [TEST_KIND_ROM_WS1_WITH_PREFETCH]       = "WS1 P",
+    [TEST_KIND_ROM_WS1_WITHOUT_PREFETCH]    = "WS1  ",
+    [TEST_KIND_ROM_WS2_WITH_PREFETCH]       = "WS2 P",
+    [TEST_KIND_ROM_WS2_WITHOUT_PREFETCH]    = "WS2  ",
+};
+
+/*
+** Passed to `harness_print_name()` to leave the waitstate setting out.
+*/
+#define HARNESS_WS_NONE     ((u32)-1)
+
+/*
+** Buffers the bodies are copied to before running from IWRAM or EWRAM.
+*/
+static u32 iwram_buffer[HARNESS_MAX_BODY_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 ewram_buffer[HARNESS_MAX_BODY_SIZE / sizeof(u32)];
+
+/*
+** Return the shift of the WAITCNT fields of the region `kind` runs from, or 0
+** if it doesn't run from ROM.
+*/
+static
+u32
+harness_ws_shift(
+    enum test_kind kind
+) {
+    switch (kind) {
+        case TEST_KIND_ROM_WITH_PREFETCH:
+        case TEST_KIND_ROM_WITHOUT_PREFETCH:        return WAITCNT_WS0_SHIFT;
+        case TEST_KIND_ROM_WS1_WITH_PREFETCH:
+        case TEST_KIND_ROM_WS1_WITHOUT_PREFETCH:    return WAITCNT_WS1_SHIFT;
+        case TEST_KIND_ROM_WS2_WITH_PREFETCH:
+        case TEST_KIND_ROM_WS2_WITHOUT_PREFETCH:    return WAITCNT_WS2_SHIFT;
+        default:                                    return 0;
+    }
+}
+
+static
+bool
+harness_prefetch(
+    enum test_kind kind
+) {
+    return (
+           kind == TEST_KIND_ROM_WITH_PREFETCH
+        || kind == TEST_KIND_ROM_WS1_WITH_PREFETCH
+        || kind == TEST_KIND_ROM_WS2_WITH_PREFETCH
+    );
+}
+
+/*
+** Return where the body of `test` must run from to match `kind`, copying it
+** there if needed, or NULL if it doesn't fit.
+**
+** The ROM is mirrored in each waitstate region, so running from WS1 or WS2 is
+** only a matter of offsetting the body's address.
+**
+** The address of a THUMB body has its lowest bit set, which must be kept for
+** the call to switch state.
+*/
+static
+harness_body_t
+harness_place(
+    struct harness_test const *test,
+    enum test_kind kind
+) {
+    u8 const *start;
+    size_t size;
+    u8 *buffer;
+
+    switch (kind) {
+        case TEST_KIND_IWRAM:   buffer = (u8 *)iwram_buffer; break;
+        case TEST_KIND_EWRAM:   buffer = (u8 *)ewram_buffer; break;
+        default: {
+            switch (harness_ws_shift(kind)) {
+                case WAITCNT_WS1_SHIFT: return (harness_body_t)((u32)test->body + 0x02000000);
+                case WAITCNT_WS2_SHIFT: return (harness_body_t)((u32)test->body + 0x04000000);
+                default:                return test->body;
+            }
+        }
+    }
+
+    start = (u8 const *)((u32)test->body & ~1);
+    size = test->body_end - start;
+    if (size > HARNESS_MAX_BODY_SIZE) {
+        return NULL;
+    }
+
+    memcpy(buffer, start, size);
+    return (harness_body_t)((u32)buffer | ((u32)test->body & 1));
+}
+
+static
+bool
+harness_thumb(
+    struct harness_test const *test
+) {
+    return (u32)test->body & 1;
+}
+
+static
+u16
+harness_variant(
+    struct test const *test,
+    u32 ws
+) {
+    u16 variant;
+
+    variant = HARNESS_VARIANT(test->kind, ws);
+    if (harness_thumb(test->data)) {
+        variant |= HARNESS_VARIANT_THUMB;
+    }
+    return variant;
+}
+
+static
+void
+harness_print_name(
+    struct test const *test,
+    u32 ws
+) {
+    log_puts(kind_names[test->kind]);
+    log_putc(' ');
+    log_dec(test->idx, 0);
+
+    if (harness_thumb(test->data)) {
+        log_puts(" THUMB");
+    }
+
+    if (ws != HARNESS_WS_NONE && harness_ws_shift(test->kind)) {
+        log_puts(" N");
+        log_dec(ws & 3, 0);
+        log_puts(" S");
+        log_dec(ws >> 2, 0);
+    }
+}
+
+/*
+** Run the body once with the waitstate setting `ws` and report it.
+** Return false if it failed, and count it in `nb_unknown` if it has no golden.
+*/
+static
+bool
+harness_run_one(
+    struct test const *test,
+    harness_body_t body,
+    u32 waitcnt,
+    u32 ws,
+    u32 *nb_unknown
+) {
+    struct harness_test const *htest;
+    u16 samples[HARNESS_MAX_SAMPLES];
+    u16 const *expected;
+    bool known;
+    size_t i;
+
+    htest = test->data;
+    expected = htest->expected + (test->kind * HARNESS_WAITSTATES_MAX + ws) * htest->nb_samples;
+
+    body(samples, waitcnt);
+
+    known = false;
+    report_begin(test->suite->id, test->idx, harness_variant(test, ws));
+    for (i = 0; i < htest->nb_samples; ++i) {
+        report_sample(samples[i], expected[i]);
+        known |= (expected[i] != 0);
+    }
+
+    if (!known) {
+        report_unknown();
+        ++*nb_unknown;
+    }
+
+    if (report_end()) {
+        return true;
+    }
+
+    for (i = 0; i < htest->nb_samples; ++i) {
+        if (samples[i] != expected[i]) {
+            harness_print_name(test, ws);
+            log_puts(": FAIL 0x");
+            log_hex(samples[i], 4);
+            log_puts(" != 0x");
+            log_hex(expected[i], 4);
+            log_putc('\n');
+            break;
+        }
+    }
+    return false;
+}
+
+/*
+** Run a test with every waitstate setting of the region it runs from, and
+** print one line for all of them unless some failed.
+*/
+void
+harness_run(
+    struct test const *test
+) {
+    struct harness_test const *htest;
+    harness_body_t body;
+    u32 waitcnt;
+    u32 shift;
+    u32 nb_ws;
+    u32 ws;
+    u32 nb_unknown;
+    bool success;
+
+    htest = test->data;
+
+    body = harness_place(htest, test->kind);
+    if (!body) {
+        report_begin(test->suite->id, test->idx, harness_variant(test, 0));
+        report_sample(htest->body_end - (u8 const *)((u32)htest->body & ~1), HARNESS_MAX_BODY_SIZE);
+        report_end();
+        harness_print_name(test, HARNESS_WS_NONE);
+        log_puts(": FAIL (body too large)\n");
+        return ;
+    }
+
+    waitcnt = REG_WAITCNT & ~WAITCNT_PREFETCH;
+    if (harness_prefetch(test->kind)) {
+        waitcnt |= WAITCNT_PREFETCH;
+    }
+
+    shift = harness_ws_shift(test->kind);
+    nb_ws = shift ? HARNESS_WAITSTATES_MAX : 1;
+
+    success = true;
+    nb_unknown = 0;
+    for (ws = 0; ws < nb_ws; ++ws) {
+        if (shift) {
+            waitcnt = (waitcnt & ~(WAITCNT_WS_MASK << shift)) | (ws << shift);
+        }
+        success &= harness_run_one(test, body, waitcnt, ws, &nb_unknown);
+    }
+
+    if (success) {
+        harness_print_name(test, HARNESS_WS_NONE);
+        log_puts(": " REPORT_PASS_STR);
+        if (!RECORD && nb_unknown) {
+            log_puts(" (");
+            log_dec(nb_unknown, 0);
+            log_puts(" without golden)");
+        }
+        log_putc('\n');
+    }
+}
@@ -0,0 +1,173 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#include "log.h"
+#include "text.h"
+
+static int debug_port;
+
+/*
+** mGBA only prints complete messages, so lines are buffered until either a
+** line feed is written or the buffer is full.
+*/
+static size_t mgba_len;
+
+static
+void
+mgba_flush(
+    void
+) {
+    REG_MGBA_DEBUG_STRING[mgba_len] = '\0';
+    REG_MGBA_DEBUG_FLAGS = MGBA_DEBUG_LEVEL_INFO | MGBA_DEBUG_SEND;
+    mgba_len = 0;
+}
+
+static
+void
+mgba_putc(
+    char c
+) {
+    if (c == '\n') {
+        mgba_flush();
+        return ;
+    }
+
+    REG_MGBA_DEBUG_STRING[mgba_len++] = c;
+
+    if (mgba_len == MGBA_DEBUG_STRING_LEN - 1) {
+        mgba_flush();
+    }
+}
+
+static
+bool
+mgba_detect(
+    void
+) {
+    REG_MGBA_DEBUG_ENABLE = MGBA_DEBUG_REQUEST;
+    return REG_MGBA_DEBUG_ENABLE == MGBA_DEBUG_ACK;
+}
+
+static
+bool
+nocash_detect(
+    void
+) {
+    char const *id;
+    size_t i;
+
+    id = "no$gba";
+    for (i = 0; id[i]; ++i) {
+        if (REG_NOCASH_ID[i] != id[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static
+void
+debug_putc(
+    char c
+) {
+    switch (debug_port) {
+        case DEBUG_PORT_MGBA: {
+            mgba_putc(c);
+            break;
+        }
+        case DEBUG_PORT_NOCASH: {
+            REG_NOCASH_CHAR_OUT = c;
+            break;
+        }
+    }
+}
+
+void
+log_putc(
+    char c
+) {
+#if !HEADLESS
+    text_putc(c);
+#endif
+    debug_putc(c);
+}
+
+void
+log_puts(
+    char const *str
+) {
+    while (*str) {
+        log_putc(*str++);
+    }
+}
+
+/*
+** Print `value` in uppercase hexadecimal, on exactly `digits` digits.
+*/
+void
+log_hex(
+    u32 value,
+    size_t digits
+) {
+    while (digits) {
+        --digits;
+        log_putc("0123456789ABCDEF"[(value >> (digits * 4)) & 0xF]);
+    }
+}
+
+/*
+** Print `value` in decimal, padded with zeroes to at least `width` digits.
+*/
+void
+log_dec(
+    u32 value,
+    size_t width
+) {
+    char buffer[10];
+    size_t len;
+
+    len = 0;
+    do {
+        buffer[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (width > len) {
+        log_putc('0');
+        --width;
+    }
+
+    while (len) {
+        log_putc(buffer[--len]);
+    }
+}
+
+void
+log_init(
+    void
+) {
+#if !HEADLESS
+    text_init();
+#endif
+
+#if DEBUG_PORT == DEBUG_PORT_AUTO
+    if (mgba_detect()) {
+        debug_port = DEBUG_PORT_MGBA;
+    } else if (nocash_detect()) {
+        debug_port = DEBUG_PORT_NOCASH;
+    } else {
+        debug_port = DEBUG_PORT_NONE;
+    }
+#elif DEBUG_PORT == DEBUG_PORT_MGBA
+    mgba_detect();
+    debug_port = DEBUG_PORT_MGBA;
+#else
+    debug_port = DEBUG_PORT;
+#endif
+}
@@ -0,0 +1,151 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <gba_interrupt.h>
+#include <gba_systemcalls.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+static struct test_selection selection;
+
+/*
+** SRAM sits on an 8-bit bus, so it must be read one byte at a time.
+*/
+static
+void
+selection_load(
+    void
+) {
+    vu8 const *sram;
+    u8 *bytes;
+    size_t i;
+
+    sram = (vu8 const *)TEST_SELECTION_SRAM_ADDR;
+    bytes = (u8 *)&selection;
+    for (i = 0; i < sizeof(selection); ++i) {
+        bytes[i] = sram[i];
+    }
+
+    if (selection.magic != TEST_SELECTION_MAGIC) {
+        selection.suites = 0;
+        selection.kinds = 0;
+        selection.nb_tests = 0;
+    }
+
+    if (selection.nb_tests > TEST_SELECTION_MAX) {
+        selection.nb_tests = TEST_SELECTION_MAX;
+    }
+}
+
+static
+bool
+selection_match(
+    struct test const *test
+) {
+    size_t i;
+
+    if (selection.suites && !(selection.suites & (1 << test->suite->id))) {
+        return false;
+    }
+
+    if (selection.kinds && !(selection.kinds & (1 << test->kind))) {
+        return false;
+    }
+
+    if (!selection.nb_tests) {
+        return true;
+    }
+
+    for (i = 0; i < selection.nb_tests; ++i) {
+        if (selection.tests[i].suite == test->suite->id && selection.tests[i].idx == test->idx) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+IWRAM_CODE
+int
+main(
+    void
+) {
+    struct report_header const *header;
+    struct suite const *suite;
+    struct test const *test;
+    u32 waitcnt;
+
+    irqInit();
+    log_init();
+    report_init();
+    selection_load();
+
+    waitcnt = REG_WAITCNT;
+
+    irqEnable(IRQ_VBLANK);
+    VBlankIntrWait();
+
+    suite = NULL;
+    for (test = __start_hades_tests; test < __stop_hades_tests; ++test) {
+        if (!selection_match(test)) {
+            continue;
+        }
+
+        if (test->suite != suite) {
+            if (suite) {
+                log_putc('\n');
+            }
+
+            suite = test->suite;
+            log_puts(suite->name);
+            log_puts("\n  ");
+            log_puts(suite->description);
+            log_puts("\n\n");
+        }
+
+        // Each test starts with the settings the ROM booted with, whichever
+        // tests ran before it.
+        REG_WAITCNT = waitcnt;
+
+        test->run(test);
+    }
+
+    header = (struct report_header const *)REPORT_ADDR;
+
+#if RECORD
+    log_puts("\nRecorded: ");
+    log_dec(header->nb_tests, 0);
+    log_putc('\n');
+#else
+    log_puts("\nTotal: ");
+    log_dec(header->nb_pass, 0);
+    log_putc('/');
+    log_dec(header->nb_pass + header->nb_fail, 0);
+    log_putc('\n');
+
+    if (header->nb_tests > header->nb_pass + header->nb_fail) {
+        log_puts("No golden: ");
+        log_dec(header->nb_tests - header->nb_pass - header->nb_fail, 0);
+        log_putc('\n');
+    }
+#endif
+
+    report_finish();
+
+#if RECORD
+    record_dump();
+#endif
+
+    while (true) {
+        VBlankIntrWait();
+    }
+
+    return (0);
+}
@@ -0,0 +1,109 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <gba_input.h>
+#include <gba_systemcalls.h>
+#include "log.h"
+#include "report.h"
+#include "text.h"
+
+/*
+** Lines of samples shown per page, leaving room for the page's header.
+*/
+#define RECORD_PAGE_LINES   (TEXT_HEIGHT - 2)
+
+static
+void
+record_wait_key(
+    void
+) {
+    while (REG_KEYINPUT & KEY_A) {
+        VBlankIntrWait();
+    }
+
+    while (!(REG_KEYINPUT & KEY_A)) {
+        VBlankIntrWait();
+    }
+}
+
+/*
+** Dump the samples of every entry of the record, one entry per line:
+**
+**     SSTTTTVVVV XXXX XXXX XXXX XXXX
+**
+** with the suite, the test and the variant in hexadecimal, followed by the
+** samples. Samples are printed on 4 digits, or 8 if any of them doesn't fit,
+** and wrap on the next line if needed.
+**
+** The dump is split in pages, A showing the next one. Headless builds, with
+** no one to press A, print everything in one go.
+*/
+void
+record_dump(
+    void
+) {
+    struct report_header const *header;
+    struct report_entry const *entry;
+    size_t nb_lines;
+    size_t page;
+    size_t i;
+
+    header = (struct report_header const *)REPORT_ADDR;
+    entry = report_first();
+
+    nb_lines = RECORD_PAGE_LINES;
+    page = 0;
+
+    for (i = 0; i < header->nb_entries; ++i, entry = report_next(entry)) {
+        size_t digits;
+        size_t column;
+        size_t j;
+
+        if (nb_lines >= RECORD_PAGE_LINES) {
+            if (!HEADLESS && page) {
+                record_wait_key();
+            }
+
+            ++page;
+            nb_lines = 0;
+            log_puts("\n-- Page ");
+            log_dec(page, 0);
+            log_puts(" (A: next) --\n");
+        }
+
+        digits = 4;
+        for (j = 0; j < entry->nb_samples; ++j) {
+            if (report_measured(entry, j) > 0xFFFF) {
+                digits = 8;
+            }
+        }
+
+        log_hex(entry->suite, 2);
+        log_hex(entry->test, 4);
+        log_hex(entry->variant, 4);
+        column = 10;
+        ++nb_lines;
+
+        for (j = 0; j < entry->nb_samples; ++j) {
+            if (column + 1 + digits > TEXT_WIDTH) {
+                log_puts("\n          ");
+                column = 10;
+                ++nb_lines;
+            }
+
+            log_putc(' ');
+            log_hex(report_measured(entry, j), digits);
+            column += 1 + digits;
+        }
+
+        log_putc('\n');
+    }
+
+    log_puts("-- End --\n");
+}
@@ -0,0 +1,240 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <gba_types.h>
+#include "report.h"
+
+/*
+** Emulators look for this string to know the cartridge is backed by SRAM.
+*/
+__attribute__((used))
+const char report_save_type[] ALIGN(4) = "SRAM_V113";
+
+static struct report_header * const header = (struct report_header *)REPORT_ADDR;
+static u8 * const entries = (u8 *)(REPORT_ADDR + sizeof(struct report_header));
+
+/*
+** The entry being filled by `report_begin()`/`report_sample()`, copied to the
+** record by `report_end()` once its length is known.
+*/
+static struct report_entry current;
+static u32 current_measured[REPORT_MAX_SAMPLES];
+static u32 current_expected[REPORT_MAX_SAMPLES];
+static bool current_success;
+static bool current_unknown;
+
+/*
+** SRAM sits on an 8-bit bus, so it must be written one byte at a time.
+*/
+static
+void
+report_mirror(
+    void const *src,
+    size_t size
+) {
+    u8 const *bytes;
+    vu8 *sram;
+    size_t i;
+
+    bytes = src;
+    sram = (vu8 *)(REPORT_SRAM_ADDR + ((u32)src - REPORT_ADDR));
+    for (i = 0; i < size; ++i) {
+        sram[i] = bytes[i];
+    }
+}
+
+void
+report_init(
+    void
+) {
+    header->magic = REPORT_MAGIC;
+    header->version = REPORT_VERSION;
+    header->entries_size = 0;
+    header->nb_tests = 0;
+    header->nb_entries = 0;
+    header->nb_pass = 0;
+    header->nb_fail = 0;
+    header->state = REPORT_STATE_RUNNING;
+
+    report_mirror(header, sizeof(*header));
+}
+
+void
+report_begin(
+    enum report_suite suite,
+    u16 test,
+    u16 variant
+) {
+    current.suite = suite;
+    current.status = REPORT_STATUS_FAIL;
+    current.test = test;
+    current.variant = variant;
+    current.nb_samples = 0;
+    current.flags = 0;
+
+    current_success = true;
+    current_unknown = false;
+}
+
+/*
+** Samples past `REPORT_MAX_SAMPLES` aren't stored but still count toward the
+** test's status.
+*/
+void
+report_sample(
+    u32 measured,
+    u32 expected
+) {
+    if (current.nb_samples < REPORT_MAX_SAMPLES) {
+        current_measured[current.nb_samples] = measured;
+        current_expected[current.nb_samples] = expected;
+        ++current.nb_samples;
+    }
+
+    current_success &= (measured == expected);
+}
+
+/*
+** Mark the current test as having no expected values yet. Its samples are
+** still recorded, but it counts neither as passed nor failed.
+*/
+void
+report_unknown(
+    void
+) {
+    current_unknown = true;
+}
+
+static
+size_t
+report_sample_size(
+    struct report_entry const *entry
+) {
+    return (entry->flags & REPORT_ENTRY_16BIT) ? sizeof(u16) : sizeof(u32);
+}
+
+static
+size_t
+report_entry_size(
+    struct report_entry const *entry
+) {
+    return sizeof(*entry) + 2 * entry->nb_samples * report_sample_size(entry);
+}
+
+/*
+** Append the current entry to the record, if it still fits, on 16 bits if all
+** its samples fit.
+*/
+static
+void
+report_store(
+    void
+) {
+    struct report_entry *entry;
+    size_t size;
+    size_t i;
+
+    current.flags = REPORT_ENTRY_16BIT;
+    for (i = 0; i < current.nb_samples; ++i) {
+        if (current_measured[i] > 0xFFFF || current_expected[i] > 0xFFFF) {
+            current.flags = 0;
+        }
+    }
+
+    size = report_entry_size(&current);
+    if (sizeof(*header) + header->entries_size + size > REPORT_SIZE) {
+        return ;
+    }
+
+    entry = (struct report_entry *)(entries + header->entries_size);
+    *entry = current;
+    for (i = 0; i < current.nb_samples; ++i) {
+        if (current.flags & REPORT_ENTRY_16BIT) {
+            ((u16 *)entry->samples)[i] = current_measured[i];
+            ((u16 *)entry->samples)[current.nb_samples + i] = current_expected[i];
+        } else {
+            ((u32 *)entry->samples)[i] = current_measured[i];
+            ((u32 *)entry->samples)[current.nb_samples + i] = current_expected[i];
+        }
+    }
+
+    ++header->nb_entries;
+    header->entries_size += size;
+    report_mirror(entry, size);
+}
+
+bool
+report_end(
+    void
+) {
+    current.status = current_success ? REPORT_STATUS_PASS : REPORT_STATUS_FAIL;
+
+    ++header->nb_tests;
+    if (current_unknown) {
+        current.status = REPORT_STATUS_NO_GOLDEN;
+        current_success = true;
+    } else if (current_success) {
+        ++header->nb_pass;
+    } else {
+        ++header->nb_fail;
+    }
+
+#if RECORD
+    current.status = REPORT_STATUS_RECORDED;
+    current_success = true;
+#endif
+
+    report_store();
+    report_mirror(header, sizeof(*header));
+
+    return current_success;
+}
+
+/*
+** Signal that the last test completed.
+*/
+void
+report_finish(
+    void
+) {
+    header->state = REPORT_STATE_DONE;
+    report_mirror(&header->state, sizeof(header->state));
+}
+
+/*
+** Walk the entries of the record, `report_next()` returning the one following
+** `entry`, until `nb_entries` of them were read.
+*/
+struct report_entry const *
+report_first(
+    void
+) {
+    return (struct report_entry const *)entries;
+}
+
+struct report_entry const *
+report_next(
+    struct report_entry const *entry
+) {
+    return (struct report_entry const *)((u8 const *)entry + report_entry_size(entry));
+}
+
+/*
+** Return the measured sample `i` of `entry`, whatever its width.
+*/
+u32
+report_measured(
+    struct report_entry const *entry,
+    size_t i
+) {
+    if (entry->flags & REPORT_ENTRY_16BIT) {
+        return ((u16 const *)entry->samples)[i];
+    }
+    return ((u32 const *)entry->samples)[i];
+}
@@ -0,0 +1,118 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <gba_video.h>
+#include "text.h"
+
+static u32 x;
+static u32 y;
+
+static
+vu16 *
+text_map_line(
+    u32 line
+) {
+    return (vu16 *)(VRAM + TEXT_SCREEN_BASE * 0x800) + (line % TEXT_MAP_HEIGHT) * 32;
+}
+
+static
+void
+text_newline(
+    void
+) {
+    vu16 *map;
+    u32 i;
+
+    x = 0;
+    ++y;
+
+    map = text_map_line(y);
+    for (i = 0; i < 32; ++i) {
+        map[i] = 0;
+    }
+
+    if (y >= TEXT_HEIGHT) {
+        REG_BG0VOFS = ((y - TEXT_HEIGHT + 1) * 8) % (TEXT_MAP_HEIGHT * 8);
+    }
+}
+
+void
+text_putc(
+    char c
+) {
+    if (c == '\n') {
+        text_newline();
+        return ;
+    }
+
+    if (x == TEXT_WIDTH) {
+        text_newline();
+    }
+
+    if (c < TEXT_FONT_FIRST || c >= TEXT_FONT_FIRST + TEXT_FONT_LEN) {
+        c = '?';
+    }
+
+    // Tile N holds the glyph of the ASCII character N.
+    text_map_line(y)[x] = c;
+    ++x;
+}
+
+/*
+** Expand the 1bpp font to 4bpp tiles using color 1, and clear the map.
+**
+** VRAM doesn't support 8-bit writes, so everything is written by words.
+*/
+void
+text_init(
+    void
+) {
+    vu32 *tiles;
+    vu16 *map;
+    u32 glyph;
+    u32 row;
+    u32 px;
+    u32 i;
+
+    tiles = (vu32 *)(VRAM + TEXT_CHAR_BASE * 0x4000);
+    for (glyph = 0; glyph < TEXT_FONT_LEN; ++glyph) {
+        for (row = 0; row < 8; ++row) {
+            u32 line;
+
+            line = 0;
+            for (px = 0; px < 8; ++px) {
+                if (text_font[glyph][row] & (1 << px)) {
+                    line |= 1 << (px * 4);
+                }
+            }
+            tiles[(TEXT_FONT_FIRST + glyph) * 8 + row] = line;
+        }
+    }
+
+    // Tile 0 is the background
+    for (row = 0; row < 8; ++row) {
+        tiles[row] = 0;
+    }
+
+    map = text_map_line(0);
+    for (i = 0; i < 32 * TEXT_MAP_HEIGHT; ++i) {
+        map[i] = 0;
+    }
+
+    BG_PALETTE[0] = RGB5(0, 0, 0);
+    BG_PALETTE[1] = RGB5(31, 31, 31);
+
+    x = 0;
+    y = 0;
+
+    REG_BG0VOFS = 0;
+    REG_BG0HOFS = 0;
+    REG_BG0CNT = CHAR_BASE(TEXT_CHAR_BASE) | SCREEN_BASE(TEXT_SCREEN_BASE);
+    REG_DISPCNT = MODE_0 | BG0_ON;
+}
@@ -0,0 +1,629 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** What multi-unit DMAs leave in memory, the cases emulators doing the copy in
+** one go with `memcpy()` or `memmove()` get wrong.
+**
+** A DMA copies its units one at a time, in order, each read followed by its
+** write, so:
+**   - Overlapping ranges propagate the units already written instead of
+**     behaving like `memmove()`.
+**   - Fixed addresses repeat the same unit or overwrite the same location,
+**     and decrementing ones go backwards.
+**   - The lowest bits of misaligned addresses are ignored.
+**   - Writes to I/O registers have the same side effects as CPU writes.
+**   - A length of 0 is the maximum length of the channel, 0x4000 units, or
+**     0x10000 for DMA3.
+**   - A higher-priority DMA runs between two units of a lower-priority one.
+**
+** The copies between buffers are compared against `copy_reference()`, which
+** does exactly that with CPU loads and stores.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_timers.h>
+#include <gba_video.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(dma_copy, REPORT_SUITE_DMA_COPY, "DMA Tests", "Bulk Copies");
+
+#define COPY_WORDS          64
+#define COPY_LARGE          0x4000
+#define COPY_MAX_SAMPLES    4
+
+#define FNV_OFFSET          0x811C9DC5
+#define FNV_PRIME           0x01000193
+
+// Registers of DMA `_n`: SAD, DAD and CNT
+#define REG_DMA(_n)         ((vu32 *)(REG_BASE + 0xB0 + 0xC * (_n)))
+
+#define REG_WININ           *(vu16 *)(REG_BASE + 0x48)
+#define REG_BLDCNT          *(vu16 *)(REG_BASE + 0x50)
+#define REG_BLDALPHA        *(vu16 *)(REG_BASE + 0x52)
+#define REG_BLDY            *(vu16 *)(REG_BASE + 0x54)
+#define REG_BG2CNT          *(vu16 *)(REG_BASE + 0xC)
+#define REG_BG3CNT          *(vu16 *)(REG_BASE + 0xE)
+
+struct copy_test {
+    char const *name;
+    u32 channel;
+    bool ewram;         // Copy within EWRAM instead of IWRAM
+    u16 src;            // Offsets within the buffer, in bytes
+    u16 dst;
+    u32 cnt;            // Control and length, as written to REG_DMAxCNT
+};
+
+static u32 copy_iwram[COPY_WORDS];
+EWRAM_BSS static u32 copy_ewram[COPY_WORDS];
+EWRAM_BSS static u32 copy_model[COPY_WORDS];
+EWRAM_BSS static u16 copy_large[COPY_LARGE];
+static u16 copy_stamps[32];
+
+/*
+** Fill `buffer` with halfwords that are all different.
+*/
+static
+void
+copy_fill(
+    u32 *buffer
+) {
+    u32 i;
+
+    for (i = 0; i < COPY_WORDS; ++i) {
+        buffer[i] = ((0xC000 | (2 * i + 1)) << 16) | (0xC000 | (2 * i));
+    }
+}
+
+static
+u32
+copy_hash(
+    u32 const *buffer
+) {
+    u32 hash;
+    u32 i;
+
+    hash = FNV_OFFSET;
+    for (i = 0; i < COPY_WORDS; ++i) {
+        hash = (hash ^ buffer[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+** Return the step of an address for the given addressing mode, 0 being
+** increment, 1 decrement, 2 fixed and 3 increment and reload.
+*/
+static
+s32
+copy_step(
+    u32 mode,
+    u32 size
+) {
+    switch (mode) {
+        case 1:     return -(s32)size;
+        case 2:     return 0;
+        default:    return size;
+    }
+}
+
+/*
+** Do the copy of `test` within `base`, one unit at a time.
+*/
+static
+void
+copy_reference(
+    u8 *base,
+    struct copy_test const *test
+) {
+    s32 src_step;
+    s32 dst_step;
+    u32 size;
+    u32 src;
+    u32 dst;
+    u32 i;
+
+    size = (test->cnt & DMA32) ? 4 : 2;
+    src_step = copy_step((test->cnt >> 23) & 3, size);
+    dst_step = copy_step((test->cnt >> 21) & 3, size);
+    src = test->src;
+    dst = test->dst;
+
+    for (i = 0; i < (test->cnt & 0xFFFF); ++i) {
+        if (size == 4) {
+            *(u32 *)(base + (dst & ~3)) = *(u32 *)(base + (src & ~3));
+        } else {
+            *(u16 *)(base + (dst & ~1)) = *(u16 *)(base + (src & ~1));
+        }
+        src += src_step;
+        dst += dst_step;
+    }
+}
+
+/*
+** Report `samples` against `expected`, and print the first mismatch.
+*/
+static
+bool
+copy_report(
+    struct test const *test,
+    char const *name,
+    u32 const *samples,
+    u32 const *expected,
+    size_t nb_samples
+) {
+    size_t i;
+
+    report_begin(REPORT_SUITE_DMA_COPY, test->idx, TEST_KIND_IWRAM);
+    for (i = 0; i < nb_samples; ++i) {
+        report_sample(samples[i], expected[i]);
+    }
+
+    log_puts(name);
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR "\n");
+        return true;
+    }
+
+    log_puts(": FAIL\n");
+    for (i = 0; i < nb_samples; ++i) {
+        if (samples[i] != expected[i]) {
+            log_puts("    0x");
+            log_hex(samples[i], 8);
+            log_puts(" != 0x");
+            log_hex(expected[i], 8);
+            log_putc('\n');
+            break;
+        }
+    }
+    return false;
+}
+
+/*
+** Copy within a buffer and compare it with the reference copy.
+*/
+static
+void
+copy_run(
+    struct test const *test
+) {
+    struct copy_test const *ctest;
+    vu32 *regs;
+    u32 *buffer;
+    u32 sample;
+    u32 expected;
+    u32 i;
+    u16 ime;
+
+    ctest = test->data;
+    buffer = ctest->ewram ? copy_ewram : copy_iwram;
+    regs = REG_DMA(ctest->channel);
+
+    copy_fill(buffer);
+    copy_fill(copy_model);
+    copy_reference((u8 *)copy_model, ctest);
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    regs[0] = (u32)buffer + ctest->src;
+    regs[1] = (u32)buffer + ctest->dst;
+    regs[2] = DMA_ENABLE | DMA_IMMEDIATE | ctest->cnt;
+
+    while (regs[2] & DMA_ENABLE);
+
+    REG_IME = ime;
+
+    sample = copy_hash(buffer);
+    expected = copy_hash(copy_model);
+
+    if (copy_report(test, ctest->name, &sample, &expected, 1)) {
+        return ;
+    }
+
+    for (i = 0; i < COPY_WORDS; ++i) {
+        if (buffer[i] != copy_model[i]) {
+            log_puts("    +0x");
+            log_hex(4 * i, 2);
+            log_puts(" 0x");
+            log_hex(buffer[i], 8);
+            log_puts(" != 0x");
+            log_hex(copy_model[i], 8);
+            log_putc('\n');
+            break;
+        }
+    }
+}
+
+#define NEW_TEST(_idx, ...)                                                 \
+    static struct copy_test const test_##_idx = { __VA_ARGS__ };          \
+    REGISTER_TEST(dma_copy, _idx, TEST_KIND_IWRAM, copy_run, &test_##_idx);
+
+/*
+** The destination overlaps the end of the source: the first units are copied
+** again and again.
+*/
+NEW_TEST(1,
+    .name = "OVERLAP FORWARD 16",
+    .channel = 3,
+    .src = 0x40,
+    .dst = 0x44,
+    .cnt = DMA16 | 32,
+)
+NEW_TEST(2,
+    .name = "OVERLAP FORWARD 32",
+    .channel = 3,
+    .src = 0x40,
+    .dst = 0x48,
+    .cnt = DMA32 | 16,
+)
+
+/*
+** The destination overlaps the beginning of the source: same as `memmove()`.
+*/
+NEW_TEST(3,
+    .name = "OVERLAP BACKWARD 32",
+    .channel = 3,
+    .src = 0x48,
+    .dst = 0x40,
+    .cnt = DMA32 | 16,
+)
+
+/*
+** Same, but both addresses decrement, so it's the other way around.
+*/
+NEW_TEST(4,
+    .name = "OVERLAP DEC FORWARD 32",
+    .channel = 3,
+    .src = 0x7C,
+    .dst = 0x84,
+    .cnt = DMA32 | DMA_SRC_DEC | DMA_DST_DEC | 16,
+)
+NEW_TEST(5,
+    .name = "OVERLAP DEC BACKWARD 32",
+    .channel = 3,
+    .src = 0x84,
+    .dst = 0x7C,
+    .cnt = DMA32 | DMA_SRC_DEC | DMA_DST_DEC | 16,
+)
+
+/*
+** Fixed source and destination.
+*/
+NEW_TEST(6,
+    .name = "SRC FIXED 16",
+    .channel = 3,
+    .src = 0x10,
+    .dst = 0x40,
+    .cnt = DMA16 | DMA_SRC_FIXED | 24,
+)
+NEW_TEST(7,
+    .name = "DST FIXED 32",
+    .channel = 3,
+    .src = 0x00,
+    .dst = 0x80,
+    .cnt = DMA32 | DMA_DST_FIXED | 16,
+)
+
+/*
+** One address increments and the other decrements, reversing the units.
+*/
+NEW_TEST(8,
+    .name = "REVERSE SRC 32",
+    .channel = 3,
+    .src = 0x3C,
+    .dst = 0x80,
+    .cnt = DMA32 | DMA_SRC_DEC | 16,
+)
+NEW_TEST(9,
+    .name = "REVERSE DST 16",
+    .channel = 3,
+    .src = 0x00,
+    .dst = 0xFE,
+    .cnt = DMA16 | DMA_DST_DEC | 32,
+)
+
+/*
+** Misaligned addresses, whose lowest bits are ignored.
+*/
+NEW_TEST(10,
+    .name = "MISALIGNED 32",
+    .channel = 3,
+    .src = 0x12,
+    .dst = 0x83,
+    .cnt = DMA32 | 8,
+)
+NEW_TEST(11,
+    .name = "MISALIGNED 16",
+    .channel = 3,
+    .src = 0x11,
+    .dst = 0x85,
+    .cnt = DMA16 | 8,
+)
+
+/*
+** Other channels, and EWRAM.
+*/
+NEW_TEST(12,
+    .name = "DMA0 OVERLAP FORWARD 32",
+    .channel = 0,
+    .src = 0x40,
+    .dst = 0x48,
+    .cnt = DMA32 | 16,
+)
+NEW_TEST(13,
+    .name = "EWRAM OVERLAP FORWARD 16",
+    .channel = 1,
+    .ewram = true,
+    .src = 0x40,
+    .dst = 0x44,
+    .cnt = DMA16 | 32,
+)
+NEW_TEST(14,
+    .name = "EWRAM REVERSE SRC 32",
+    .channel = 2,
+    .ewram = true,
+    .src = 0x3C,
+    .dst = 0x80,
+    .cnt = DMA32 | DMA_SRC_DEC | 16,
+)
+
+/*
+** Copy to registers that can be read back: BLDCNT and BLDALPHA, one after the
+** other, WININ four times, and BG2CNT and BG3CNT with a single 32-bit unit.
+*/
+static u16 const copy_io_blend[3] = { 0x3F41, 0x0C08, 0x0010 };
+static u16 const copy_io_win[4] = { 0x0102, 0x0304, 0x0506, 0x1A2B };
+static u32 const copy_io_bg = 0xC98B1204;
+
+static
+void
+copy_run_io(
+    struct test const *test
+) {
+    u32 samples[3];
+    u32 expected[3];
+    u16 bg2cnt;
+    u16 bg3cnt;
+    u16 ime;
+
+    ime = REG_IME;
+    REG_IME = 0;
+    bg2cnt = REG_BG2CNT;
+    bg3cnt = REG_BG3CNT;
+
+    REG_DMA3SAD = (u32)copy_io_blend;
+    REG_DMA3DAD = (u32)&REG_BLDCNT;
+    REG_DMA3CNT = DMA_ENABLE | DMA16 | 3;
+    while (REG_DMA3CNT & DMA_ENABLE);
+
+    REG_DMA3SAD = (u32)copy_io_win;
+    REG_DMA3DAD = (u32)&REG_WININ;
+    REG_DMA3CNT = DMA_ENABLE | DMA16 | DMA_DST_FIXED | 4;
+    while (REG_DMA3CNT & DMA_ENABLE);
+
+    REG_DMA3SAD = (u32)&copy_io_bg;
+    REG_DMA3DAD = (u32)&REG_BG2CNT;
+    REG_DMA3CNT = DMA_ENABLE | DMA32 | 1;
+    while (REG_DMA3CNT & DMA_ENABLE);
+
+    samples[0] = (REG_BLDCNT & 0x3FFF) | ((REG_BLDALPHA & 0x1F1F) << 16);
+    samples[1] = REG_WININ & 0x3F3F;
+    samples[2] = REG_BG2CNT | (REG_BG3CNT << 16);
+
+    REG_BLDCNT = 0;
+    REG_BLDALPHA = 0;
+    REG_BLDY = 0;
+    REG_WININ = 0;
+    REG_BG2CNT = bg2cnt;
+    REG_BG3CNT = bg3cnt;
+    REG_IME = ime;
+
+    expected[0] = 0x0C083F41;
+    expected[1] = 0x1A2B;
+    expected[2] = copy_io_bg;
+
+    copy_report(test, "IO REGISTERS", samples, expected, 3);
+}
+
+REGISTER_TEST(dma_copy, 15, TEST_KIND_IWRAM, copy_run_io, NULL);
+
+/*
+** Copy a single word to IE and IF. IF's half acknowledges the interrupts it
+** has set, Timer 1's, instead of being stored as-is.
+*/
+static u32 const copy_irq_word = (IRQ_TIMER1 << 16) | 0x1234;
+
+static
+void
+copy_run_irq(
+    struct test const *test
+) {
+    u32 samples[2];
+    u32 expected[2];
+    u16 ie;
+    u16 ime;
+
+    ime = REG_IME;
+    REG_IME = 0;
+    ie = REG_IE;
+
+    // Have both Timer 1 and Timer 2 request an interrupt
+    REG_TM1CNT_H = 0;
+    REG_TM2CNT_H = 0;
+    REG_TM1CNT_L = 0xFFFF;
+    REG_TM2CNT_L = 0xFFFF;
+    REG_TM1CNT_H = TIMER_START | TIMER_IRQ;
+    REG_TM2CNT_H = TIMER_START | TIMER_IRQ;
+
+    while ((REG_IF & (IRQ_TIMER1 | IRQ_TIMER2)) != (IRQ_TIMER1 | IRQ_TIMER2));
+
+    REG_TM1CNT_H = 0;
+    REG_TM2CNT_H = 0;
+
+    REG_DMA3SAD = (u32)&copy_irq_word;
+    REG_DMA3DAD = (u32)&REG_IE;
+    REG_DMA3CNT = DMA_ENABLE | DMA32 | 1;
+    while (REG_DMA3CNT & DMA_ENABLE);
+
+    samples[0] = REG_IE;
+    samples[1] = REG_IF & (IRQ_TIMER1 | IRQ_TIMER2);
+
+    REG_IE = ie;
+    REG_IF = IRQ_TIMER1 | IRQ_TIMER2;
+    REG_IME = ime;
+
+    expected[0] = 0x1234;
+    expected[1] = IRQ_TIMER2;
+
+    copy_report(test, "IO IE/IF", samples, expected, 2);
+}
+
+REGISTER_TEST(dma_copy, 16, TEST_KIND_IWRAM, copy_run_irq, NULL);
+
+/*
+** Run each channel with a length of 0, every unit going to the same
+** halfword, which ends up holding the last one read.
+**
+** DMA0 can't read the GamePak, so it reads `copy_large`, whose halfwords hold
+** their index. The other channels read the ROM.
+*/
+static
+void
+copy_run_length(
+    struct test const *test
+) {
+    u32 samples[4];
+    u32 expected[4];
+    u32 channel;
+    u32 i;
+    vu32 *regs;
+    u16 ime;
+
+    for (i = 0; i < COPY_LARGE; ++i) {
+        copy_large[i] = i;
+    }
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    for (channel = 0; channel < 4; ++channel) {
+        regs = REG_DMA(channel);
+        copy_iwram[0] = 0xDEADDEAD;
+
+        regs[0] = channel ? 0x08000000 : (u32)copy_large;
+        regs[1] = (u32)copy_iwram;
+        regs[2] = DMA_ENABLE | DMA16 | DMA_DST_FIXED | 0;
+
+        while (regs[2] & DMA_ENABLE);
+
+        samples[channel] = copy_iwram[0];
+    }
+
+    REG_IME = ime;
+
+    expected[0] = 0xDEAD0000 | (COPY_LARGE - 1);
+    expected[1] = 0xDEAD0000 | *(vu16 *)(0x08000000 + 2 * (0x4000 - 1));
+    expected[2] = expected[1];
+    expected[3] = 0xDEAD0000 | *(vu16 *)(0x08000000 + 2 * (0x10000 - 1));
+
+    copy_report(test, "LENGTH 0", samples, expected, 4);
+}
+
+REGISTER_TEST(dma_copy, 17, TEST_KIND_IWRAM, copy_run_length, NULL);
+
+/*
+** Copy 0x1000 halfwords within EWRAM with DMA3, about 20 scanlines long,
+** while DMA0 copies Timer 0's counter at every HBlank.
+**
+** DMA0 has the highest priority, so it runs in the middle of the copy, every
+** 1232 cycles, give or take the unit of DMA3 it waited for, and DMA3 resumes
+** where it stopped.
+*/
+static
+void
+copy_run_priority(
+    struct test const *test
+) {
+    u32 samples[3];
+    u32 expected[3];
+    u32 nb_stamps;
+    u32 delta;
+    u16 start;
+    u16 end;
+    u16 vcount;
+    u16 ime;
+    u32 i;
+
+    for (i = 0; i < COPY_LARGE; ++i) {
+        copy_large[i] = i;
+    }
+
+    for (i = 0; i < 32; ++i) {
+        copy_stamps[i] = 0xFFFF;
+    }
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    // Start at the beginning of a scanline, far enough from VBlank for every
+    // HBlank of the copy to trigger DMA0
+    while (REG_VCOUNT >= 100);
+    vcount = REG_VCOUNT;
+    while (REG_VCOUNT == vcount);
+
+    REG_TM0CNT_H = 0;
+    REG_TM0CNT_L = 0;
+    REG_TM0CNT_H = TIMER_START;
+
+    REG_DMA0SAD = (u32)&REG_TM0CNT_L;
+    REG_DMA0DAD = (u32)copy_stamps;
+    REG_DMA0CNT = DMA_ENABLE | DMA_HBLANK | DMA_REPEAT | DMA16 | DMA_SRC_FIXED | 1;
+
+    start = REG_TM0CNT_L;
+
+    REG_DMA3SAD = (u32)copy_large;
+    REG_DMA3DAD = (u32)(copy_large + 0x2000);
+    REG_DMA3CNT = DMA_ENABLE | DMA16 | 0x1000;
+
+    end = REG_TM0CNT_L;
+
+    REG_DMA0CNT = 0;
+    REG_TM0CNT_H = 0;
+    REG_IME = ime;
+
+    // DMA0 ran at least twice during the copy, 1232 cycles apart
+    nb_stamps = 0;
+    samples[1] = 1;
+    for (i = 0; i < 32 && copy_stamps[i] > start && copy_stamps[i] < end; ++i) {
+        if (i) {
+            delta = copy_stamps[i] - copy_stamps[i - 1];
+            samples[1] &= (delta >= 1232 - 8 && delta <= 1232 + 8);
+        }
+        ++nb_stamps;
+    }
+    samples[0] = nb_stamps >= 2;
+
+    // DMA3's copy is complete
+    samples[2] = 1;
+    for (i = 0; i < 0x1000; ++i) {
+        samples[2] &= (copy_large[0x2000 + i] == i);
+    }
+
+    expected[0] = 1;
+    expected[1] = 1;
+    expected[2] = 1;
+
+    copy_report(test, "PRIORITY", samples, expected, 3);
+}
+
+REGISTER_TEST(dma_copy, 18, TEST_KIND_IWRAM, copy_run_priority, NULL);
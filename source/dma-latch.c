@@ -15,23 +15,24 @@
 **   - https://mgba.io/2020/01/25/infinite-loop-holy-grail/
 */
 
-#include <gba_console.h>
-#include <gba_interrupt.h>
 #include <gba_timers.h>
 #include <gba_dma.h>
-#include <gba_systemcalls.h>
 #include <gba_sound.h>
-#include <stdio.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(dma_latch, REPORT_SUITE_DMA_LATCH, "DMA Tests", "Latch & Open Bus");
 
 /*
 ** Check that DMA's reads are latched.
 */
 IWRAM_CODE
-bool
+static
+void
 dma_latch_test_1(
-    void
+    struct test const *test
 ) {
-    bool success;
     u32 data;
     u32 res;
     u32 unused;
@@ -55,30 +56,35 @@ dma_latch_test_1(
 
     while (REG_DMA0CNT & DMA_ENABLE);
 
-    if (res == 0xCAFEBABE) {
-        printf("DMA LATCH 1: PASS\n");
-        success = true;
+    report_begin(REPORT_SUITE_DMA_LATCH, test->idx, test->kind);
+    report_sample(res, (u32)0xCAFEBABE);
+
+    if (report_end()) {
+        log_puts("DMA LATCH 1: " REPORT_PASS_STR "\n");
     } else {
-        printf("DMA LATCH 1: FAIL\n");
-        printf("    0x%08lx != 0x%08lx\n", res, (u32)0xCAFEBABE);
-        success = false;
+        log_puts("DMA LATCH 1: FAIL\n");
+        log_puts("    0x");
+        log_hex(res, 8);
+        log_puts(" != 0x");
+        log_hex(0xCAFEBABE, 8);
+        log_putc('\n');
     }
 
     REG_DMA0CNT = 0;
     REG_DMA1CNT = 0;
-
-    return success;
 }
 
+REGISTER_TEST(dma_latch, 1, TEST_KIND_IWRAM, dma_latch_test_1, NULL);
+
 /*
 ** Check that each DMA has its own latch, different from each other.
 */
 IWRAM_CODE
-bool
+static
+void
 dma_latch_test_2(
-    void
+    struct test const *test
 ) {
-    bool success;
     u32 data_dma0;
     u32 data_dma1;
     u32 unused;
@@ -112,30 +118,35 @@ dma_latch_test_2(
 
     while (REG_DMA1CNT & DMA_ENABLE);
 
-    if (res == 0x2BADCAFE) {
-        printf("DMA LATCH 2: PASS\n");
-        success = true;
+    report_begin(REPORT_SUITE_DMA_LATCH, test->idx, test->kind);
+    report_sample(res, (u32)0x2BADCAFE);
+
+    if (report_end()) {
+        log_puts("DMA LATCH 2: " REPORT_PASS_STR "\n");
     } else {
-        printf("DMA LATCH 2: FAIL\n");
-        printf("    0x%08lx != 0x%08lx\n", res, (u32)0x2BADCAFE);
-        success = false;
+        log_puts("DMA LATCH 2: FAIL\n");
+        log_puts("    0x");
+        log_hex(res, 8);
+        log_puts(" != 0x");
+        log_hex(0x2BADCAFE, 8);
+        log_putc('\n');
     }
 
     REG_DMA0CNT = 0;
     REG_DMA1CNT = 0;
-
-    return success;
 }
 
+REGISTER_TEST(dma_latch, 2, TEST_KIND_IWRAM, dma_latch_test_2, NULL);
+
 /*
 ** Check that the first access of a DMA, if invalid, reads the last prefetched opcode.
 */
 IWRAM_CODE
-bool
+static
+void
 dma_latch_test_3(
-    void
+    struct test const *test
 ) {
-    bool success;
     u32 data;
     u32 unused;
     u32 res;
@@ -159,20 +170,25 @@ dma_latch_test_3(
 
     while (REG_DMA0CNT & DMA_ENABLE);
 
-    if (res == 0xe3530000) {
-        printf("DMA LATCH 3: PASS\n");
-        success = true;
+    report_begin(REPORT_SUITE_DMA_LATCH, test->idx, test->kind);
+    report_sample(res, 0xE3530000);
+
+    if (report_end()) {
+        log_puts("DMA LATCH 3: " REPORT_PASS_STR "\n");
     } else {
-        printf("DMA LATCH 3: FAIL\n");
-        printf("    0x%08lx != 0x%08x\n", res, 0xe3530000);
-        success = false;
+        log_puts("DMA LATCH 3: FAIL\n");
+        log_puts("    0x");
+        log_hex(res, 8);
+        log_puts(" != 0x");
+        log_hex(0xE3530000, 8);
+        log_putc('\n');
     }
 
     REG_DMA0CNT = 0;
-
-    return success;
 }
 
+REGISTER_TEST(dma_latch, 3, TEST_KIND_IWRAM, dma_latch_test_3, NULL);
+
 /*
 ** Check that the first invalid access that follows a DMA reads the latest value read by that DMA.
 **
@@ -182,12 +198,13 @@ dma_latch_test_3(
 **   - https://mgba.io/2020/01/25/infinite-loop-holy-grail/
 */
 IWRAM_CODE
-bool
+static
+void
 dma_latch_test_4(
-    void
+    struct test const *test
 ) {
-    bool success;
     u32 data;
+    u32 x;
 
     data = 0xFEEDC0DE;
 
@@ -208,20 +225,14 @@ dma_latch_test_4(
     REG_TM2CNT_L = 0x0000;
     REG_TM2CNT_H = TIMER_START | TIMER_COUNT;
 
-    printf("DMA LATCH 4: ...\n");
+    log_puts("DMA LATCH 4: ");
 
     while (42) {
         // Read from invalid memory, hoping the DMA left our desired value
         // in the memory bus.
-        u32 x = *(u32 volatile *)0x04000FF0;
+        x = *(u32 volatile *)0x04000FF0;
 
-        if (x == 0xFEEDC0DE) {
-            printf(CON_UP(1) "DMA LATCH 4: PASS\n");
-            success = true;
-            break;
-        } else if (REG_TM2CNT_L >= 3) {
-            printf(CON_UP(1) "DMA LATCH 4: FAIL (Timeout)\n");
-            success = false;
+        if (x == 0xFEEDC0DE || REG_TM2CNT_L >= 3) {
             break;
         }
     }
@@ -231,44 +242,19 @@ dma_latch_test_4(
     REG_TM2CNT_H = 0;
     REG_DMA1CNT = 0;
 
-    return success;
-}
-
-IWRAM_CODE
-int
-main(
-    void
-) {
-    size_t nb_tests;
-    u32 nb_tests_passed;
-    u32 i;
-
-    irqInit();
-    consoleDemoInit();
-
-    printf("DMA Tests\n");
-    printf("  Latch & Open Bus\n\n");
-
-    bool (* const tests[])(void) = {
-        dma_latch_test_1,
-        dma_latch_test_2,
-        dma_latch_test_3,
-        dma_latch_test_4,
-    };
+    report_begin(REPORT_SUITE_DMA_LATCH, test->idx, test->kind);
+    report_sample(x, 0xFEEDC0DE);
 
-    nb_tests = sizeof(tests) / sizeof(tests[0]);
-
-    for (i = 0; i < nb_tests; ++i) {
-        nb_tests_passed += tests[i]();
-    }
-
-    printf("\n");
-    printf("Total: %lu/%zu\n", nb_tests_passed, nb_tests);
-
-    while (true) {
-        VBlankIntrWait();
+    if (report_end()) {
+        log_puts(REPORT_PASS_STR "\n");
+    } else {
+        log_puts("FAIL\n");
+        log_puts("    0x");
+        log_hex(x, 8);
+        log_puts(" != 0x");
+        log_hex(0xFEEDC0DE, 8);
+        log_putc('\n');
     }
-
-    return (0);
 }
 
+REGISTER_TEST(dma_latch, 4, TEST_KIND_IWRAM, dma_latch_test_4, NULL);
@@ -0,0 +1,723 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** How long immediate DMAs take, for every pair of regions, width, addressing
+** mode, channel and length, the cost emulators doing the copy in one go have
+** to charge exactly.
+**
+** Each transfer is timed by Timer 0, started right before the DMA and read
+** right after it, from IWRAM. Every test first times a single 16-bit transfer
+** from IWRAM to IWRAM, and reports the duration of the others relative to it,
+** so the time the DMA takes to start and to give the bus back cancels out.
+**
+** The durations are predicted by `dma_model()`, with WAITCNT set to 0:
+**   - A DMA takes 2 internal cycles to start, 4 if both its source and its
+**     destination are in the GamePak.
+**   - Each unit is read, then written. The first read and the first write are
+**     non-sequential, the following ones are sequential, except for GamePak
+**     accesses crossing a 128KB boundary.
+**   - GamePak sources always increment, whatever their addressing mode.
+**   - A 32-bit access on a 16-bit bus is a 16-bit access of the same type
+**     followed by a sequential one.
+**
+** The display is blanked while the tests run, so the PPU doesn't compete for
+** the palette, VRAM or OAM.
+**
+** None of these rules was checked on hardware yet. Each case is reported as
+** its own variant, its index, and checked against its row in `recorded`, that
+** `tools/goldens.py` prints from a `RECORD=1` run. Until then, the cases are
+** reported without golden, with the model's prediction as expected values so
+** a record can be compared to it, or 0 for transfers from or to SRAM, and to
+** ROM, that the model doesn't cover.
+**
+** The last test only checks that the four channels start in the same cycle.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_timers.h>
+#include <gba_video.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(dma_timing, REPORT_SUITE_DMA_TIMING, "DMA Tests", "Transfer Timings");
+
+#define DMA_TESTS           13
+#define DMA_MAX_CASES       12
+#define DMA_MAX_SAMPLES     4
+#define DMA_MAX_UNITS       8
+
+// Registers of DMA `_n`: SAD, DAD and CNT
+#define REG_DMA(_n)         ((vu32 *)(REG_BASE + 0xB0 + 0xC * (_n)))
+
+enum dma_region {
+    DMA_REGION_BIOS,
+    DMA_REGION_EWRAM,
+    DMA_REGION_IWRAM,
+    DMA_REGION_IO,
+    DMA_REGION_PAL,
+    DMA_REGION_VRAM,
+    DMA_REGION_OAM,
+    DMA_REGION_ROM,
+    DMA_REGION_SRAM,
+
+    DMA_REGION_MAX,
+};
+
+static char const * const region_names[DMA_REGION_MAX] = {
+    [DMA_REGION_BIOS]   = "BIOS",
+    [DMA_REGION_EWRAM]  = "EWRAM",
+    [DMA_REGION_IWRAM]  = "IWRAM",
+    [DMA_REGION_IO]     = "IO",
+    [DMA_REGION_PAL]    = "PAL",
+    [DMA_REGION_VRAM]   = "VRAM",
+    [DMA_REGION_OAM]    = "OAM",
+    [DMA_REGION_ROM]    = "ROM",
+    [DMA_REGION_SRAM]   = "SRAM",
+};
+
+/*
+** `DMA_MAX_UNITS` words in each region, that the DMAs can read and overwrite
+** without disturbing the display or the other tests:
+**   - The affine parameters of BG2 and BG3, unused in mode 0.
+**   - The last entries of the OBJ palette, VRAM and OAM, unused with OBJs off.
+**   - The end of SRAM, past the test selection.
+** Reads from the BIOS return open bus, and writes to the BIOS and the ROM are
+** ignored.
+*/
+static u32 dma_iwram[DMA_MAX_UNITS];
+EWRAM_BSS static u32 dma_ewram[DMA_MAX_UNITS];
+static u32 const dma_rom[DMA_MAX_UNITS * 2] ALIGN(64) = {
+    0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210,
+};
+
+static u32 const region_addrs[DMA_REGION_MAX] = {
+    [DMA_REGION_BIOS]   = 0x00000000,
+    [DMA_REGION_EWRAM]  = (u32)dma_ewram,
+    [DMA_REGION_IWRAM]  = (u32)dma_iwram,
+    [DMA_REGION_IO]     = 0x04000020,
+    [DMA_REGION_PAL]    = 0x050003E0,
+    [DMA_REGION_VRAM]   = 0x06017FE0,
+    [DMA_REGION_OAM]    = 0x070003E0,
+    [DMA_REGION_ROM]    = (u32)dma_rom,
+    [DMA_REGION_SRAM]   = 0x0E007FE0,
+};
+
+/*
+** The arguments of `dma_timing_run()`, and the value it read.
+*/
+struct dma_run {
+    vu32 *regs;         // REG_DMAxSAD of the channel
+    u32 sad;
+    u32 dad;
+    u32 cnt;            // Written to REG_DMAxCNT, length included
+    u16 elapsed;        // REG_TM0CNT_L once the DMA completed
+};
+
+/*
+** Run from IWRAM, where every access takes a single cycle.
+**
+** The DMA starts during the `nop`s following the write enabling it, and the
+** CPU stays stopped until it completes, so the timer is read a fixed number of
+** cycles after the end of the transfer.
+*/
+__asm__(
+    ".pushsection .iwram, \"ax\", %progbits\n"
+    ".balign 4\n"
+    ".arm\n"
+    "dma_timing_run:\n"
+    "push {r4-r6, lr}\n"
+
+    // Set r12 to REG_TM0CNT
+    "ldr r12, =#0x04000100\n"
+
+    // Stop the timer and set its reload value to 0
+    "mov r5, #0\n"
+    "str r5, [r12]\n"
+
+    // Set the DMA's addresses
+    "ldm r0, {r1-r4}\n"
+    "str r2, [r1]\n"
+    "str r3, [r1, #0x4]\n"
+
+    // Start the timer, then the DMA
+    "mov r5, #0x00800000\n"
+    "str r5, [r12]\n"
+    "str r4, [r1, #0x8]\n"
+    "nop\n"
+    "nop\n"
+    "nop\n"
+    "nop\n"
+
+    // Read the timer's value
+    "ldrh r6, [r12]\n"
+
+    // Stop the timer
+    "mov r5, #0\n"
+    "str r5, [r12]\n"
+
+    "strh r6, [r0, #0x10]\n"
+
+    "pop {r4-r6, lr}\n"
+    "bx lr\n"
+    ".ltorg\n"
+    ".popsection\n"
+);
+
+__attribute__((long_call))
+void dma_timing_run(struct dma_run *run);
+
+struct dma_transfer {
+    u32 channel;
+    u32 src;
+    u32 dst;
+    u32 cnt;            // Control and length, as written to REG_DMAxCNT
+};
+
+/*
+** Fill `transfer` with the transfer of sample `sample` of case `c`, and
+** return false if `dma_model()` doesn't cover it.
+*/
+typedef bool (*dma_transfer_t)(u32 arg, u32 c, u32 sample, struct dma_transfer *transfer);
+
+struct dma_timing_test {
+    char const *name;
+    dma_transfer_t transfer;
+    u32 arg;
+    u32 nb_cases;
+    u32 nb_samples;
+    char const * const *case_names;
+    char const * const *sample_names;
+};
+
+/*
+** Return the number of cycles of an access to `addr`, with WAITCNT set to 0.
+*/
+static
+u32
+dma_access(
+    u32 addr,
+    bool word,
+    bool seq
+) {
+    u32 n;
+    u32 s;
+
+    switch (addr >> 24) {
+        case 0x2:               return word ? 6 : 3;
+        case 0x5:
+        case 0x6:               return word ? 2 : 1;
+        case 0x8: case 0x9:     n = 5; s = 3; break;
+        case 0xA: case 0xB:     n = 5; s = 5; break;
+        case 0xC: case 0xD:     n = 5; s = 9; break;
+        case 0xE: case 0xF:     return 5;
+        default:                return 1;
+    }
+
+    return (seq ? s : n) + (word ? s : 0);
+}
+
+static
+bool
+dma_gamepak(
+    u32 addr
+) {
+    return addr >= 0x08000000;
+}
+
+/*
+** Return the step of an address for the given addressing mode, 0 being
+** increment, 1 decrement, 2 fixed and 3 increment and reload.
+*/
+static
+s32
+dma_step(
+    u32 mode,
+    u32 size
+) {
+    switch (mode) {
+        case 1:     return -(s32)size;
+        case 2:     return 0;
+        default:    return size;
+    }
+}
+
+/*
+** Return the number of cycles `transfer` takes, from its first internal cycle
+** to its last write.
+*/
+static
+u32
+dma_model(
+    struct dma_transfer const *transfer
+) {
+    u32 src;
+    u32 dst;
+    s32 src_step;
+    s32 dst_step;
+    u32 cycles;
+    u32 size;
+    bool word;
+    u32 i;
+
+    word = transfer->cnt & DMA32;
+    size = word ? 4 : 2;
+    src = transfer->src;
+    dst = transfer->dst;
+    src_step = dma_gamepak(src) ? (s32)size : dma_step((transfer->cnt >> 23) & 3, size);
+    dst_step = dma_step((transfer->cnt >> 21) & 3, size);
+
+    cycles = (dma_gamepak(src) && dma_gamepak(dst)) ? 4 : 2;
+    for (i = 0; i < (transfer->cnt & 0xFFFF); ++i) {
+        cycles += dma_access(src, word, i && (src & 0x1FFFF));
+        cycles += dma_access(dst, word, i && (dst & 0x1FFFF));
+        src += src_step;
+        dst += dst_step;
+    }
+    return cycles;
+}
+
+/*
+** Return the value of Timer 0 right after `transfer` completed.
+*/
+static
+u16
+dma_measure(
+    struct dma_transfer const *transfer
+) {
+    struct dma_run run;
+
+    run.regs = REG_DMA(transfer->channel);
+    run.sad = transfer->src;
+    run.dad = transfer->dst;
+    run.cnt = DMA_ENABLE | DMA_IMMEDIATE | transfer->cnt;
+    dma_timing_run(&run);
+    return run.elapsed;
+}
+
+/*
+** Durations measured on hardware, for each case of the tests timing transfers.
+** The rows `tools/goldens.py` prints for test N go in `recorded[N - 1]`.
+*/
+static u16 const recorded[DMA_TESTS][DMA_MAX_CASES][DMA_MAX_SAMPLES] = {
+    { { 0 } },
+};
+
+static_assert(DMA_REGION_MAX <= DMA_MAX_CASES);
+
+static struct dma_transfer const dma_baseline = {
+    .channel = 3,
+    .src = (u32)dma_iwram,
+    .dst = (u32)dma_iwram + 4,
+    .cnt = DMA16 | 1,
+};
+
+/*
+** Report case `c` of `test`, and keep it in `failed` if it is the first one
+** failing.
+*/
+static
+void
+dma_report(
+    struct test const *test,
+    u32 c,
+    u16 const *measured,
+    u16 const *expected,
+    bool known,
+    s32 *failed,
+    u32 *nb_unknown
+) {
+    struct dma_timing_test const *dtest;
+    u32 i;
+
+    dtest = test->data;
+
+    report_begin(REPORT_SUITE_DMA_TIMING, test->idx, c);
+    for (i = 0; i < dtest->nb_samples; ++i) {
+        report_sample(measured[i], expected[i]);
+    }
+
+    if (!known) {
+        report_unknown();
+        ++*nb_unknown;
+    }
+
+    if (!report_end() && *failed < 0) {
+        *failed = c;
+    }
+}
+
+static
+void
+dma_print(
+    struct test const *test,
+    s32 failed,
+    u16 const *measured,
+    u16 const *expected,
+    u32 nb_unknown
+) {
+    struct dma_timing_test const *dtest;
+    u32 i;
+
+    dtest = test->data;
+
+    log_puts(dtest->name);
+    if (failed < 0) {
+        log_puts(": " REPORT_PASS_STR);
+        if (!RECORD && nb_unknown) {
+            log_puts(" (");
+            log_dec(nb_unknown, 0);
+            log_puts(" without golden)");
+        }
+        log_putc('\n');
+        return ;
+    }
+
+    log_puts(": FAIL (");
+    log_puts(dtest->case_names[failed]);
+    log_puts(")\n");
+    for (i = 0; i < dtest->nb_samples; ++i) {
+        if (measured[i] != expected[i]) {
+            log_puts("    ");
+            log_puts(dtest->sample_names[i]);
+            log_puts(" 0x");
+            log_hex(measured[i], 4);
+            log_puts(" != 0x");
+            log_hex(expected[i], 4);
+            log_putc('\n');
+        }
+    }
+}
+
+/*
+** Time every transfer of `test`, relative to `dma_baseline`, and check them
+** against `recorded`.
+*/
+static
+void
+dma_run_test(
+    struct test const *test
+) {
+    struct dma_timing_test const *dtest;
+    struct dma_transfer transfer;
+    u16 measured[DMA_MAX_SAMPLES];
+    u16 expected[DMA_MAX_SAMPLES];
+    u16 failed_measured[DMA_MAX_SAMPLES];
+    u16 failed_expected[DMA_MAX_SAMPLES];
+    u16 baseline;
+    u16 baseline_model;
+    u16 const *golden;
+    u32 nb_unknown;
+    s32 failed;
+    bool modeled;
+    bool known;
+    u32 waitcnt;
+    u16 dispcnt;
+    u16 ime;
+    u32 c;
+    u32 i;
+
+    dtest = test->data;
+    failed = -1;
+    nb_unknown = 0;
+
+    ime = REG_IME;
+    REG_IME = 0;
+    dispcnt = REG_DISPCNT;
+    REG_DISPCNT = dispcnt | LCDC_OFF;
+    waitcnt = REG_WAITCNT;
+    REG_WAITCNT = 0;
+
+    baseline = dma_measure(&dma_baseline);
+    baseline_model = dma_model(&dma_baseline);
+
+    for (c = 0; c < dtest->nb_cases; ++c) {
+        golden = recorded[test->idx - 1][c];
+        known = false;
+        for (i = 0; i < dtest->nb_samples; ++i) {
+            known |= !!golden[i];
+        }
+
+        for (i = 0; i < dtest->nb_samples; ++i) {
+            modeled = dtest->transfer(dtest->arg, c, i, &transfer);
+            measured[i] = dma_measure(&transfer) - baseline;
+            if (known) {
+                expected[i] = golden[i];
+            } else if (modeled) {
+                expected[i] = dma_model(&transfer) - baseline_model;
+            } else {
+                expected[i] = 0;
+            }
+        }
+
+        dma_report(test, c, measured, expected, known, &failed, &nb_unknown);
+
+        if (failed == (s32)c) {
+            for (i = 0; i < dtest->nb_samples; ++i) {
+                failed_measured[i] = measured[i];
+                failed_expected[i] = expected[i];
+            }
+        }
+    }
+
+    REG_WAITCNT = waitcnt;
+    REG_DISPCNT = dispcnt;
+    REG_IME = ime;
+
+    dma_print(test, failed, failed_measured, failed_expected, nb_unknown);
+}
+
+/*
+** Channel 3, every width and length, from region `src` to region `c`.
+*/
+static char const * const pair_samples[] = { "16x1", "16x8", "32x1", "32x8" };
+
+static
+bool
+dma_pair(
+    u32 src,
+    u32 c,
+    u32 sample,
+    struct dma_transfer *transfer
+) {
+    transfer->channel = 3;
+    transfer->src = region_addrs[src];
+    transfer->dst = region_addrs[c];
+    transfer->cnt = ((sample & 2) ? DMA32 : DMA16) | ((sample & 1) ? DMA_MAX_UNITS : 1);
+
+    return src != DMA_REGION_SRAM && c != DMA_REGION_SRAM && c != DMA_REGION_ROM;
+}
+
+/*
+** Every channel allowed to read region `src`, with each addressing mode of
+** the source, and of the destination for each sample, 32 bits at a time.
+*/
+static char const * const mode_samples[] = { "DST INC", "DST DEC", "DST FIXED", "DST RELOAD" };
+
+static char const * const mode_ewram_cases[] = {
+    "DMA0 SRC INC", "DMA0 SRC DEC", "DMA0 SRC FIXED",
+    "DMA1 SRC INC", "DMA1 SRC DEC", "DMA1 SRC FIXED",
+    "DMA2 SRC INC", "DMA2 SRC DEC", "DMA2 SRC FIXED",
+    "DMA3 SRC INC", "DMA3 SRC DEC", "DMA3 SRC FIXED",
+};
+
+static
+bool
+dma_modes(
+    u32 src,
+    u32 c,
+    u32 sample,
+    struct dma_transfer *transfer
+) {
+    u32 src_mode;
+
+    // DMA0 can't read the GamePak.
+    transfer->channel = c / 3 + (src == DMA_REGION_ROM);
+
+    src_mode = c % 3;
+    transfer->src = region_addrs[src] + (src_mode == 1 ? 4 * (DMA_MAX_UNITS - 1) : 0);
+    transfer->dst = (u32)dma_iwram + (sample == 1 ? 4 * (DMA_MAX_UNITS - 1) : 0);
+    transfer->cnt = DMA32 | (src_mode << 23) | (sample << 21) | DMA_MAX_UNITS;
+    return true;
+}
+
+/*
+** Sequential accesses to the GamePak: 8 units within a 128KB block and
+** across two, and from each waitstate region.
+*/
+static char const * const rom_cases[] = { "128KB BOUNDARY", "WAITSTATES" };
+static char const * const rom_samples[] = { "#0", "#1", "#2", "#3" };
+
+static
+bool
+dma_rom_seq(
+    u32 arg __attribute__((unused)),
+    u32 c,
+    u32 sample,
+    struct dma_transfer *transfer
+) {
+    transfer->channel = 3;
+    transfer->dst = (u32)dma_iwram;
+
+    if (!c) {
+        // 16 bits, then 32 bits, within a block, then across two
+        transfer->cnt = ((sample & 2) ? DMA32 : DMA16) | DMA_MAX_UNITS;
+        transfer->src = (sample & 1) ? 0x08020000 - ((sample & 2) ? 16 : 8) : (u32)dma_rom;
+    } else {
+        // 32 bits from WS0, WS1 and WS2, then 16 bits from WS2
+        transfer->cnt = (sample < 3 ? DMA32 : DMA16) | DMA_MAX_UNITS;
+        transfer->src = (u32)dma_rom + 0x02000000 * (sample < 3 ? sample : 2);
+    }
+    return true;
+}
+
+/*
+** Long transfers, from ROM and EWRAM, all written to the same word.
+*/
+static u16 const sweep_lengths[] = { 1, 2, 3, 4, 8, 64, 512, 4096 };
+
+static char const * const sweep_cases[] = { "x1", "x2", "x3", "x4", "x8", "x64", "x512", "x4096" };
+static char const * const sweep_samples[] = { "ROM 16", "ROM 32", "EWRAM 16", "EWRAM 32" };
+
+static
+bool
+dma_sweep(
+    u32 arg __attribute__((unused)),
+    u32 c,
+    u32 sample,
+    struct dma_transfer *transfer
+) {
+    transfer->channel = 3;
+    transfer->src = (sample & 2) ? 0x02000000 : 0x08000000;
+    transfer->dst = (u32)dma_iwram;
+    transfer->cnt = ((sample & 1) ? DMA32 : DMA16) | DMA_DST_FIXED | sweep_lengths[c];
+    return true;
+}
+
+/*
+** The value of Timer 0 read by each channel, relative to the one DMA0 reads
+** with a 16-bit transfer.
+**
+** The channels take as long to start, whatever their width, so they all read
+** the same value. `dma-start-delay` checks the value itself.
+*/
+static char const * const start_cases[] = { "DMA0", "DMA1", "DMA2", "DMA3" };
+static char const * const start_samples[] = { "16 BITS", "32 BITS" };
+
+static
+void
+dma_run_start_test(
+    struct test const *test
+) {
+    struct dma_transfer transfer;
+    u16 measured[DMA_MAX_SAMPLES];
+    u16 expected[DMA_MAX_SAMPLES];
+    u16 failed_measured[DMA_MAX_SAMPLES];
+    u16 failed_expected[DMA_MAX_SAMPLES];
+    u16 reference;
+    u32 nb_unknown;
+    s32 failed;
+    u16 dispcnt;
+    u16 ime;
+    u32 c;
+    u32 i;
+
+    failed = -1;
+    nb_unknown = 0;
+    reference = 0;
+
+    ime = REG_IME;
+    REG_IME = 0;
+    dispcnt = REG_DISPCNT;
+    REG_DISPCNT = dispcnt | LCDC_OFF;
+
+    for (c = 0; c < 4; ++c) {
+        for (i = 0; i < 2; ++i) {
+            transfer.channel = c;
+            transfer.src = (u32)&REG_TM0CNT_L;
+            transfer.dst = (u32)dma_iwram;
+            transfer.cnt = (i ? DMA32 : DMA16) | 1;
+            dma_measure(&transfer);
+
+            if (!c && !i) {
+                reference = dma_iwram[0];
+            }
+
+            measured[i] = dma_iwram[0] - reference;
+            expected[i] = 0;
+        }
+
+        dma_report(test, c, measured, expected, true, &failed, &nb_unknown);
+
+        if (failed == (s32)c) {
+            for (i = 0; i < 2; ++i) {
+                failed_measured[i] = measured[i];
+                failed_expected[i] = expected[i];
+            }
+        }
+    }
+
+    REG_DISPCNT = dispcnt;
+    REG_IME = ime;
+
+    dma_print(test, failed, failed_measured, failed_expected, nb_unknown);
+}
+
+#define NEW_TEST(_idx, _run, ...)                                           \
+    static struct dma_timing_test const test_##_idx = { __VA_ARGS__ };    \
+    REGISTER_TEST(dma_timing, _idx, TEST_KIND_IWRAM, _run, &test_##_idx);
+
+#define NEW_TIMING_TEST(_idx, ...)                                          \
+    static_assert((_idx) <= DMA_TESTS);                                     \
+    NEW_TEST(_idx, dma_run_test, __VA_ARGS__)
+
+#define NEW_PAIR_TEST(_idx, _name, _src)                                    \
+    NEW_TIMING_TEST(_idx,                                                   \
+        .name = (_name),                                                    \
+        .transfer = dma_pair,                                               \
+        .arg = (_src),                                                      \
+        .nb_cases = DMA_REGION_MAX,                                         \
+        .nb_samples = 4,                                                    \
+        .case_names = region_names,                                         \
+        .sample_names = pair_samples,                                       \
+    )
+
+NEW_PAIR_TEST(1, "BIOS ->", DMA_REGION_BIOS)
+NEW_PAIR_TEST(2, "EWRAM ->", DMA_REGION_EWRAM)
+NEW_PAIR_TEST(3, "IWRAM ->", DMA_REGION_IWRAM)
+NEW_PAIR_TEST(4, "IO ->", DMA_REGION_IO)
+NEW_PAIR_TEST(5, "PAL ->", DMA_REGION_PAL)
+NEW_PAIR_TEST(6, "VRAM ->", DMA_REGION_VRAM)
+NEW_PAIR_TEST(7, "OAM ->", DMA_REGION_OAM)
+NEW_PAIR_TEST(8, "ROM ->", DMA_REGION_ROM)
+NEW_PAIR_TEST(9, "SRAM ->", DMA_REGION_SRAM)
+
+NEW_TIMING_TEST(10,
+    .name = "EWRAM MODES",
+    .transfer = dma_modes,
+    .arg = DMA_REGION_EWRAM,
+    .nb_cases = 12,
+    .nb_samples = 4,
+    .case_names = mode_ewram_cases,
+    .sample_names = mode_samples,
+)
+NEW_TIMING_TEST(11,
+    .name = "ROM MODES",
+    .transfer = dma_modes,
+    .arg = DMA_REGION_ROM,
+    .nb_cases = 9,
+    .nb_samples = 4,
+    .case_names = mode_ewram_cases + 3,
+    .sample_names = mode_samples,
+)
+NEW_TIMING_TEST(12,
+    .name = "ROM SEQUENTIAL",
+    .transfer = dma_rom_seq,
+    .nb_cases = 2,
+    .nb_samples = 4,
+    .case_names = rom_cases,
+    .sample_names = rom_samples,
+)
+NEW_TIMING_TEST(13,
+    .name = "LENGTHS",
+    .transfer = dma_sweep,
+    .nb_cases = 8,
+    .nb_samples = 4,
+    .case_names = sweep_cases,
+    .sample_names = sweep_samples,
+)
+NEW_TEST(14, dma_run_start_test,
+    .name = "START DELAY",
+    .nb_cases = 4,
+    .nb_samples = 2,
+    .case_names = start_cases,
+    .sample_names = start_samples,
+)
@@ -0,0 +1,548 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** HALT and IntrWait while timers, DMAs and interrupts keep running, the case
+** emulators speed up by skipping the CPU straight to the next event.
+**
+** The time it takes to wake up and go through the interrupt handlers isn't
+** known, but it is the same every time. So the tests wait for two consecutive
+** occurrences of an event and check what changed between the two wake-ups:
+** a reference timer must have advanced by exactly the period of the event,
+** and the counters, DMAs and handlers by exactly one period's worth.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_sound.h>
+#include <gba_systemcalls.h>
+#include <gba_timers.h>
+#include <gba_video.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(halt, REPORT_SUITE_HALT, "Halt Tests", "Wake-ups & Cycle Skipping");
+
+#define HALT_MAX_SAMPLES    4
+#define HALT_VCOUNT         100
+
+// Registers of DMA `_n`: SAD, DAD and CNT
+#define REG_DMA(_n)         ((vu32 *)(REG_BASE + 0xB0 + 0xC * (_n)))
+
+// Ticks of the reference timer between two occurrences of each event
+#define PERIOD_FRAME_P64    0x1125      // 280896 cycles
+#define PERIOD_LINE_P1      0x04D0      // 1232 cycles
+#define PERIOD_TIMER_P1     0x1000      // 4096 cycles, see `HALT_TIMER_RELOAD`
+
+#define HALT_TIMER_RELOAD   0xF000
+
+struct halt_test {
+    char const *name;
+    u16 irq;            // Interrupt waking the CPU
+    u16 ref;            // Reference timer
+    u16 prescaler;      // Prescaler of the reference timer
+    u32 expected[HALT_MAX_SAMPLES];
+};
+
+/*
+** Written by the interrupt handlers.
+*/
+static u32 volatile halt_events;
+static u32 volatile halt_count;
+
+static u32 halt_scratch;
+
+static
+void
+halt_report(
+    struct test const *test,
+    u32 const *samples,
+    size_t nb_samples
+) {
+    struct halt_test const *htest;
+    size_t i;
+
+    htest = test->data;
+
+    report_begin(REPORT_SUITE_HALT, test->idx, TEST_KIND_IWRAM);
+    for (i = 0; i < nb_samples; ++i) {
+        report_sample(samples[i], htest->expected[i]);
+    }
+
+    log_puts(htest->name);
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR "\n");
+        return ;
+    }
+
+    for (i = 0; i < nb_samples; ++i) {
+        if (samples[i] != htest->expected[i]) {
+            log_puts(": FAIL 0x");
+            log_hex(samples[i], 4);
+            log_puts(" != 0x");
+            log_hex(htest->expected[i], 4);
+            log_putc('\n');
+            break;
+        }
+    }
+}
+
+/*
+** Wait for the beginning of a visible scanline, so the tests have a whole
+** HDraw to set things up and enough scanlines before VBlank, during which
+** HBlank DMAs don't run.
+*/
+static
+void
+halt_wait_line(
+    void
+) {
+    u16 vcount;
+
+    while (REG_VCOUNT >= 150);
+    vcount = REG_VCOUNT;
+    while (REG_VCOUNT == vcount);
+}
+
+/*
+** Set up the source of `irq` so it fires periodically.
+**
+** Timers overflow every 4096 cycles, DMA0 runs on VBlank and the other DMAs on
+** HBlank, all of them copying a word to a scratch variable.
+*/
+static
+void
+halt_source_start(
+    u16 irq
+) {
+    vu32 *dma;
+    u32 idx;
+
+    idx = __builtin_ctz(irq);
+
+    switch (irq) {
+        case IRQ_VBLANK: {
+            REG_DISPSTAT |= LCDC_VBL;
+            break;
+        }
+        case IRQ_HBLANK: {
+            REG_DISPSTAT |= LCDC_HBL;
+            break;
+        }
+        case IRQ_VCOUNT: {
+            REG_DISPSTAT = (REG_DISPSTAT & 0xFF) | LCDC_VCNT | VCOUNT(HALT_VCOUNT);
+            break;
+        }
+        case IRQ_TIMER0:
+        case IRQ_TIMER1:
+        case IRQ_TIMER2:
+        case IRQ_TIMER3: {
+            (&REG_TM0CNT)[idx - 3] = HALT_TIMER_RELOAD | ((TIMER_START | TIMER_IRQ) << 16);
+            break;
+        }
+        case IRQ_DMA0:
+        case IRQ_DMA1:
+        case IRQ_DMA2:
+        case IRQ_DMA3: {
+            dma = REG_DMA(idx - 8);
+            dma[0] = (u32)&halt_scratch;
+            dma[1] = (u32)&halt_scratch;
+            dma[2] = (
+                  DMA_ENABLE
+                | DMA_IRQ
+                | DMA_REPEAT
+                | (irq == IRQ_DMA0 ? DMA_VBLANK : DMA_HBLANK)
+                | DMA_SRC_FIXED
+                | DMA_DST_FIXED
+                | DMA32
+                | 1
+            );
+            break;
+        }
+    }
+}
+
+static
+void
+halt_source_stop(
+    u16 irq
+) {
+    u32 idx;
+
+    idx = __builtin_ctz(irq);
+
+    if (irq >= IRQ_TIMER0 && irq <= IRQ_TIMER3) {
+        (&REG_TM0CNT)[idx - 3] = 0;
+    } else if (irq >= IRQ_DMA0 && irq <= IRQ_DMA3) {
+        REG_DMA(idx - 8)[2] = 0;
+    }
+}
+
+/*
+** Wake up from IntrWait on two consecutive interrupts of `htest->irq` and
+** compare the reference timer between the two.
+*/
+IWRAM_CODE
+static
+void
+halt_wake(
+    struct test const *test
+) {
+    struct halt_test const *htest;
+    vu16 *ref;
+    u32 samples[1];
+    u16 dispstat;
+    u16 first;
+    u16 ie;
+
+    htest = test->data;
+    ref = &(&REG_TM0CNT_L)[2 * htest->ref];
+
+    ie = REG_IE;
+    dispstat = REG_DISPSTAT;
+    REG_IE = htest->irq;
+
+    halt_wait_line();
+
+    (&REG_TM0CNT)[htest->ref] = (TIMER_START | htest->prescaler) << 16;
+    halt_source_start(htest->irq);
+
+    IntrWait(true, htest->irq);
+    first = *ref;
+    IntrWait(true, htest->irq);
+    samples[0] = (u16)(*ref - first);
+
+    halt_source_stop(htest->irq);
+    (&REG_TM0CNT)[htest->ref] = 0;
+
+    REG_DISPSTAT = dispstat;
+    REG_IF = htest->irq;
+    REG_IE = ie;
+
+    halt_report(test, samples, 1);
+}
+
+#define NEW_WAKE_TEST(_idx, _name, _irq, _ref, _prescaler, _period)         \
+    static struct halt_test const test_##_idx = {                           \
+        .name = (_name),                                                    \
+        .irq = (_irq),                                                      \
+        .ref = (_ref),                                                      \
+        .prescaler = (_prescaler),                                          \
+        .expected = { (_period) },                                          \
+    };                                                                      \
+    REGISTER_TEST(halt, _idx, TEST_KIND_IWRAM, halt_wake, &test_##_idx);
+
+NEW_WAKE_TEST(1,  "VBLANK",  IRQ_VBLANK, 0, 1, PERIOD_FRAME_P64)
+NEW_WAKE_TEST(2,  "HBLANK",  IRQ_HBLANK, 0, 0, PERIOD_LINE_P1)
+NEW_WAKE_TEST(3,  "VCOUNT",  IRQ_VCOUNT, 0, 1, PERIOD_FRAME_P64)
+NEW_WAKE_TEST(4,  "TIMER 0", IRQ_TIMER0, 1, 0, PERIOD_TIMER_P1)
+NEW_WAKE_TEST(5,  "TIMER 1", IRQ_TIMER1, 2, 0, PERIOD_TIMER_P1)
+NEW_WAKE_TEST(6,  "TIMER 2", IRQ_TIMER2, 3, 0, PERIOD_TIMER_P1)
+NEW_WAKE_TEST(7,  "TIMER 3", IRQ_TIMER3, 0, 0, PERIOD_TIMER_P1)
+NEW_WAKE_TEST(8,  "DMA 0",   IRQ_DMA0,   0, 1, PERIOD_FRAME_P64)
+NEW_WAKE_TEST(9,  "DMA 1",   IRQ_DMA1,   0, 0, PERIOD_LINE_P1)
+NEW_WAKE_TEST(10, "DMA 2",   IRQ_DMA2,   0, 0, PERIOD_LINE_P1)
+NEW_WAKE_TEST(11, "DMA 3",   IRQ_DMA3,   0, 0, PERIOD_LINE_P1)
+
+/*
+** Stop Timer `_n` and log its overflow in `halt_events`, a nibble per event.
+*/
+#define TIMER_HANDLER(_n)                                                   \
+    static                                                                  \
+    void                                                                    \
+    halt_timer##_n##_handler(                                               \
+        void                                                                \
+    ) {                                                                     \
+        REG_TM##_n##CNT_H = 0;                                              \
+        halt_events = (halt_events << 4) | (_n);                            \
+        ++halt_count;                                                       \
+    }
+
+TIMER_HANDLER(0)
+TIMER_HANDLER(1)
+TIMER_HANDLER(2)
+TIMER_HANDLER(3)
+
+static
+void
+halt_count_handler(
+    void
+) {
+    ++halt_count;
+}
+
+/*
+** Halt four times while the four timers run, set to overflow 4096 cycles
+** apart, in the reverse order of their index. Each overflow must wake the CPU
+** once, in order.
+*/
+IWRAM_CODE
+static
+void
+halt_order(
+    struct test const *test
+) {
+    u32 samples[2];
+    u16 ie;
+
+    ie = REG_IE;
+    REG_IE = IRQ_TIMER0 | IRQ_TIMER1 | IRQ_TIMER2 | IRQ_TIMER3;
+
+    irqSet(IRQ_TIMER0, halt_timer0_handler);
+    irqSet(IRQ_TIMER1, halt_timer1_handler);
+    irqSet(IRQ_TIMER2, halt_timer2_handler);
+    irqSet(IRQ_TIMER3, halt_timer3_handler);
+
+    halt_events = 0;
+    halt_count = 0;
+
+    REG_TM0CNT = 0xC000 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_TM1CNT = 0xD000 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_TM2CNT = 0xE000 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_TM3CNT = 0xF000 | ((TIMER_START | TIMER_IRQ) << 16);
+
+    Halt();
+    Halt();
+    Halt();
+    Halt();
+
+    samples[0] = halt_events;
+    samples[1] = halt_count;
+
+    irqSet(IRQ_TIMER0, NULL);
+    irqSet(IRQ_TIMER1, NULL);
+    irqSet(IRQ_TIMER2, NULL);
+    irqSet(IRQ_TIMER3, NULL);
+
+    REG_IE = ie;
+
+    halt_report(test, samples, 2);
+}
+
+/*
+** Halt across a cascade: Timer 0 overflows every 256 cycles, Timer 1 counts
+** them and wakes the CPU every 16, and Timer 2 counts Timer 1's overflows.
+**
+** Between two wake-ups, Timer 3 runs for exactly 4096 cycles, Timer 2 counts
+** one overflow, and Timers 0 and 1 are back to the same value.
+*/
+IWRAM_CODE
+static
+void
+halt_cascade(
+    struct test const *test
+) {
+    u32 samples[4];
+    u16 first[4];
+    u16 ie;
+
+    ie = REG_IE;
+    REG_IE = IRQ_TIMER1;
+
+    REG_TM3CNT = TIMER_START << 16;
+    REG_TM2CNT = 0x0000 | ((TIMER_START | TIMER_COUNT) << 16);
+    REG_TM1CNT = 0xFFF0 | ((TIMER_START | TIMER_COUNT | TIMER_IRQ) << 16);
+    REG_TM0CNT = 0xFF00 | (TIMER_START << 16);
+
+    Halt();
+    first[3] = REG_TM3CNT_L;
+    first[2] = REG_TM2CNT_L;
+    first[1] = REG_TM1CNT_L;
+    first[0] = REG_TM0CNT_L;
+    Halt();
+    samples[0] = (u16)(REG_TM3CNT_L - first[3]);
+    samples[1] = (u16)(REG_TM2CNT_L - first[2]);
+    samples[2] = (u16)(REG_TM1CNT_L - first[1]);
+    samples[3] = (u16)(REG_TM0CNT_L - first[0]);
+
+    REG_TM0CNT = 0;
+    REG_TM1CNT = 0;
+    REG_TM2CNT = 0;
+    REG_TM3CNT = 0;
+
+    REG_IF = IRQ_TIMER1;
+    REG_IE = ie;
+
+    halt_report(test, samples, 4);
+}
+
+/*
+** IntrWait on the interrupt of an HBlank DMA copying Timer 0's counter to a
+** new halfword every time.
+**
+** Each wake-up must follow exactly one transfer, and the transfers must be
+** one scanline apart.
+*/
+IWRAM_CODE
+static
+void
+halt_dma_progress(
+    struct test const *test
+) {
+    u16 values[5];
+    u32 samples[4];
+    u16 ie;
+    u32 i;
+
+    for (i = 0; i < 5; ++i) {
+        values[i] = 0xDEAD;
+    }
+
+    ie = REG_IE;
+    REG_IE = IRQ_DMA3;
+
+    REG_TM0CNT = TIMER_START << 16;
+
+    halt_wait_line();
+
+    REG_DMA3SAD = (u32)&REG_TM0CNT_L;
+    REG_DMA3DAD = (u32)values;
+    REG_DMA3CNT = DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_HBLANK | DMA_SRC_FIXED | DMA_DST_INC | DMA16 | 1;
+
+    IntrWait(true, IRQ_DMA3);
+    IntrWait(true, IRQ_DMA3);
+    IntrWait(true, IRQ_DMA3);
+    IntrWait(true, IRQ_DMA3);
+
+    REG_DMA3CNT = 0;
+    REG_TM0CNT = 0;
+
+    REG_IF = IRQ_DMA3;
+    REG_IE = ie;
+
+    samples[0] = (u16)(values[1] - values[0]);
+    samples[1] = (u16)(values[2] - values[1]);
+    samples[2] = (u16)(values[3] - values[2]);
+    samples[3] = values[4];
+
+    halt_report(test, samples, 4);
+}
+
+/*
+** IntrWait on Timer 1, overflowing every 4096 cycles, while Timer 3 overflows
+** every 1024 cycles, 512 cycles away from any of Timer 1's overflows: 4 times
+** between two of them, the closest being 512 cycles before and after each.
+** Timer 3's interrupts must be handled without ending the wait.
+*/
+IWRAM_CODE
+static
+void
+halt_intrwait_filter(
+    struct test const *test
+) {
+    u32 samples[2];
+    u32 count;
+    u16 first;
+    u16 ie;
+
+    ie = REG_IE;
+    REG_IE = IRQ_TIMER1 | IRQ_TIMER3;
+
+    irqSet(IRQ_TIMER3, halt_count_handler);
+    halt_count = 0;
+
+    REG_TM0CNT = TIMER_START << 16;
+    REG_TM1CNT = 0xF000 | ((TIMER_START | TIMER_IRQ) << 16);
+
+    // Timer 3 first overflows 512 cycles after Timer 1 started, then every
+    // 1024 cycles.
+    REG_TM3CNT = 0xFE00 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_TM3CNT_L = 0xFC00;
+
+    IntrWait(true, IRQ_TIMER1);
+    first = REG_TM0CNT_L;
+    count = halt_count;
+    IntrWait(true, IRQ_TIMER1);
+    samples[0] = (u16)(REG_TM0CNT_L - first);
+    samples[1] = halt_count - count;
+
+    REG_TM0CNT = 0;
+    REG_TM1CNT = 0;
+    REG_TM3CNT = 0;
+
+    irqSet(IRQ_TIMER3, NULL);
+
+    REG_IF = IRQ_TIMER1 | IRQ_TIMER3;
+    REG_IE = ie;
+
+    halt_report(test, samples, 2);
+}
+
+/*
+** IntrWait on Timer 2, overflowing every 65536 cycles, while DMA1 refills
+** FIFO A every 16 samples of Timer 0, so every 4096 cycles. Timer 2 first
+** overflows 1920 cycles after Timer 0 started, away from any of Timer 0's
+** overflows.
+**
+** Between two wake-ups, exactly 16 refills must have happened and Timer 3,
+** running at 1/64, must have advanced by exactly 1024.
+*/
+IWRAM_CODE
+static
+void
+halt_fifo(
+    struct test const *test
+) {
+    u32 samples[2];
+    u32 count;
+    u16 first;
+    u16 ie;
+
+    ie = REG_IE;
+    REG_IE = IRQ_TIMER2 | IRQ_DMA1;
+
+    irqSet(IRQ_DMA1, halt_count_handler);
+    halt_count = 0;
+
+    REG_SOUNDCNT_X |= SNDSTAT_ENABLE;
+    REG_SOUNDCNT_H = SNDA_RESET_FIFO | SNDA_R_ENABLE | SNDA_L_ENABLE;
+
+    REG_DMA1SAD = (u32)&halt_scratch;
+    REG_DMA1DAD = (u32)&REG_FIFO_A;
+    REG_DMA1CNT = DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_SPECIAL | DMA_SRC_FIXED | DMA_DST_FIXED | DMA32 | 1;
+
+    REG_TM3CNT = (TIMER_START | 1) << 16;
+    REG_TM0CNT = 0xFF00 | (TIMER_START << 16);
+    REG_TM2CNT = 0xF880 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_TM2CNT_L = 0x0000;
+
+    IntrWait(true, IRQ_TIMER2);
+    first = REG_TM3CNT_L;
+    count = halt_count;
+    IntrWait(true, IRQ_TIMER2);
+    samples[0] = (u16)(REG_TM3CNT_L - first);
+    samples[1] = halt_count - count;
+
+    REG_DMA1CNT = 0;
+    REG_TM0CNT = 0;
+    REG_TM2CNT = 0;
+    REG_TM3CNT = 0;
+    REG_SOUNDCNT_H = 0;
+
+    irqSet(IRQ_DMA1, NULL);
+
+    REG_IF = IRQ_TIMER2 | IRQ_DMA1;
+    REG_IE = ie;
+
+    halt_report(test, samples, 2);
+}
+
+#define NEW_TEST(_idx, _name, _run, ...)                                    \
+    static struct halt_test const test_##_idx = {                           \
+        .name = (_name),                                                    \
+        .expected = { __VA_ARGS__ },                                        \
+    };                                                                      \
+    REGISTER_TEST(halt, _idx, TEST_KIND_IWRAM, _run, &test_##_idx);
+
+NEW_TEST(12, "ORDER",           halt_order,             0x3210, 4)
+NEW_TEST(13, "CASCADE",         halt_cascade,           0x1000, 1, 0, 0)
+NEW_TEST(14, "DMA PROGRESS",    halt_dma_progress,      PERIOD_LINE_P1, PERIOD_LINE_P1, PERIOD_LINE_P1, 0xDEAD)
+NEW_TEST(15, "INTRWAIT FILTER", halt_intrwait_filter,   PERIOD_TIMER_P1, 4)
+NEW_TEST(16, "FIFO DMA",        halt_fifo,              0x400, 16)
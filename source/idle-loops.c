@@ -0,0 +1,319 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Busy-wait loops commonly found in games, the kind emulators detect and skip
+** to save host CPU time. Each of them must end exactly when it would have
+** on hardware.
+**
+** Loops waiting for an event the code doesn't control (a new scanline, an
+** HBlank, ...) exit anywhere within an iteration of the event, so they wait
+** for two consecutive events and measure the time between the two exits. The
+** loops take 7 cycles per iteration, which divides both the length of a
+** scanline (1232 cycles) and the period of the timers they wait for, and the
+** code between two loops is padded to a multiple of 7 cycles, so the second
+** loop exits at the same point of its iteration as the first one.
+**
+** Loops polling the enable bit of a DMA aren't here: the DMA stalls the CPU
+** in the middle of an iteration, by a number of cycles that isn't known, so
+** their exits can't be derived that way. They will be once they are recorded
+** on hardware.
+**
+** The loops are tuned for the timings of IWRAM, so the tests only run from
+** there.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_timers.h>
+#include <gba_video.h>
+#include "harness.h"
+#include "test.h"
+
+NEW_SUITE(idle_loops, REPORT_SUITE_IDLE_LOOPS, "Idle Loops", "Busy-wait patterns");
+
+#define NEW_TEST(_idx, _expected, _code) \
+    NEW_HARNESS_TEST(test_0##_idx, _expected, _code); \
+    REGISTER_HARNESS_TEST(idle_loops, (_idx), TEST_KIND_IWRAM, test_0##_idx);
+
+/*
+** Wait for REG_VCOUNT to change, twice, and measure the time between the two.
+**
+** Both loops exit 1232 cycles apart, the timer is started 8 cycles after the
+** first one exits and read 5 cycles after the second one does.
+*/
+static u16 const TEST_01_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)] = { 0x04CC },
+};
+NEW_TEST(1, TEST_01_RESULTS, {
+    u16 ime;
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    __asm__ volatile(
+        // Set r1 to REG_VCOUNT and r3 to REG_TM0CNT
+        "ldr r1, =#0x04000006\n"
+        "ldr r3, =#0x04000100\n"
+
+        // Stop the timer and set its reload value to 0
+        "mov r0, #0\n"
+        "strh r0, [r3, #0x2]\n"
+        "strh r0, [r3]\n"
+
+        // Wait for the next scanline
+        "ldrh r2, [r1]\n"
+        "1:\n"
+        "ldrh r0, [r1]\n"   // 1S + 1N + 1I
+        "cmp r0, r2\n"      // 1S
+        "beq 1b\n"          // 2S + 1N
+
+        // Start the timer
+        "mov r2, r0\n"
+        "mov r0, #0x80\n"
+        "strh r0, [r3, #0x2]\n"
+
+        // Pad to a multiple of 7 cycles
+        "nop\n"
+        "nop\n"
+        "nop\n"
+        "nop\n"
+        "nop\n"
+
+        // Wait for the next scanline
+        "2:\n"
+        "ldrh r0, [r1]\n"
+        "cmp r0, r2\n"
+        "beq 2b\n"
+
+        // Read the timer's value
+        "ldrh r4, [r3]\n"
+
+        // Stop the timer
+        "mov r0, #0\n"
+        "strh r0, [r3, #0x2]\n"
+
+        "mov %[sample], r4\n"
+        :
+            [sample]"=r"(samples[0])
+        :
+        :
+            "r0", "r1", "r2", "r3", "r4", "cc"
+    );
+
+    REG_IME = ime;
+});
+
+/*
+** Poll a timer's counter until it reaches 0x100.
+**
+** The loop reads the counter every 7 cycles, starting 1 cycle after the timer
+** was started, so it exits on 0x103. The next read comes 5 cycles later.
+*/
+static u16 const TEST_02_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][2] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)] = { 0x0103, 0x0108 },
+};
+NEW_TEST(2, TEST_02_RESULTS, {
+    u16 ime;
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    __asm__ volatile(
+        // Set r3 to REG_TM0CNT
+        "ldr r3, =#0x04000100\n"
+
+        // Stop the timer and set its reload value to 0
+        "mov r0, #0\n"
+        "strh r0, [r3, #0x2]\n"
+        "strh r0, [r3]\n"
+
+        // Start the timer
+        "mov r2, #0x100\n"
+        "mov r0, #0x80\n"
+        "strh r0, [r3, #0x2]\n"
+
+        // Wait for the counter to reach 0x100
+        "1:\n"
+        "ldrh r0, [r3]\n"
+        "cmp r0, r2\n"
+        "blo 1b\n"
+
+        // Read the timer's value once more
+        "ldrh r4, [r3]\n"
+
+        // Stop the timer
+        "mov r2, #0\n"
+        "strh r2, [r3, #0x2]\n"
+
+        "mov %[sample1], r0\n"
+        "mov %[sample2], r4\n"
+        :
+            [sample1]"=r"(samples[0]),
+            [sample2]"=r"(samples[1])
+        :
+        :
+            "r0", "r2", "r3", "r4", "cc"
+    );
+
+    REG_IME = ime;
+});
+
+/*
+** Poll REG_IF until Timer 1 overflows, twice, and measure the time between the
+** two.
+**
+** Timer 1 overflows every 280 cycles. The timer measuring it is started 9
+** cycles after the first loop exits and read 5 cycles after the second one
+** does. Whatever the delay between the overflow and the flag being set, it is
+** the same for both overflows.
+*/
+static u16 const TEST_03_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)] = { 0x0113 },
+};
+NEW_TEST(3, TEST_03_RESULTS, {
+    u16 ime;
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    __asm__ volatile(
+        // Set r1 to REG_IF and r3 to REG_TM0CNT
+        "ldr r1, =#0x04000202\n"
+        "ldr r3, =#0x04000100\n"
+
+        // Stop both timers, set Timer 0's reload value to 0 and Timer 1's to
+        // 0x10000 - 280
+        "mov r0, #0\n"
+        "strh r0, [r3, #0x2]\n"
+        "strh r0, [r3, #0x6]\n"
+        "strh r0, [r3]\n"
+        "ldr r0, =#0xFEE8\n"
+        "strh r0, [r3, #0x4]\n"
+
+        // Acknowledge Timer 1's interrupt and start it, with interrupts enabled
+        "mov r2, #0x10\n"
+        "strh r2, [r1]\n"
+        "mov r0, #0xC0\n"
+        "strh r0, [r3, #0x6]\n"
+
+        // Wait for Timer 1 to overflow
+        "1:\n"
+        "ldrh r0, [r1]\n"
+        "tst r0, r2\n"
+        "beq 1b\n"
+
+        // Acknowledge the interrupt and start Timer 0
+        "strh r2, [r1]\n"
+        "mov r0, #0x80\n"
+        "strh r0, [r3, #0x2]\n"
+
+        // Pad to a multiple of 7 cycles
+        "nop\n"
+        "nop\n"
+        "nop\n"
+        "nop\n"
+
+        // Wait for Timer 1 to overflow again
+        "2:\n"
+        "ldrh r0, [r1]\n"
+        "tst r0, r2\n"
+        "beq 2b\n"
+
+        // Read Timer 0's value
+        "ldrh r4, [r3]\n"
+
+        // Stop both timers and acknowledge the last interrupt
+        "mov r0, #0\n"
+        "strh r0, [r3, #0x2]\n"
+        "strh r0, [r3, #0x6]\n"
+        "strh r2, [r1]\n"
+
+        "mov %[sample], r4\n"
+        :
+            [sample]"=r"(samples[0])
+        :
+        :
+            "r0", "r1", "r2", "r3", "r4", "cc"
+    );
+
+    REG_IME = ime;
+});
+
+/*
+** Poll open bus until an HBlank DMA leaves a value on it.
+**
+** Before the DMA, open bus reads the opcode fetched last, 8 bytes after the
+** load (`mov r3, #0x42`, 0xE3A03042). The first read following the DMA reads
+** the value it transferred, 0xFEEDC0DE.
+**
+** The loop gives up after 0x10000 iterations, leaving the last opcode in
+** `r0` instead.
+*/
+static u16 const TEST_04_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][4] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)] = { 0x3042, 0xE3A0, 0xC0DE, 0xFEED },
+};
+NEW_TEST(4, TEST_04_RESULTS, {
+    u32 data;
+    u32 unused;
+    u16 vcount;
+    u16 ime;
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    data = 0xFEEDC0DE;
+
+    // Wait for the beginning of a visible scanline, leaving a whole HDraw for
+    // the first read to happen before the DMA
+    while (REG_VCOUNT >= 150);
+    vcount = REG_VCOUNT;
+    while (REG_VCOUNT == vcount);
+
+    REG_DMA3SAD = (u32)&data;
+    REG_DMA3DAD = (u32)&unused;
+    REG_DMA3CNT = DMA_ENABLE | DMA_HBLANK | DMA32 | 1;
+
+    __asm__ volatile(
+        // Set r1 to an unused I/O register and r5 to the value to wait for
+        "ldr r1, =#0x04000FF0\n"
+        "ldr r5, =#0xFEEDC0DE\n"
+        "mov r6, #0x10000\n"
+
+        // Read open bus
+        "ldr r4, [r1]\n"
+        "nop\n"
+        "mov r3, #0x42\n"
+
+        // Wait for the DMA's value to show up on open bus
+        "1:\n"
+        "ldr r0, [r1]\n"
+        "cmp r0, r5\n"
+        "beq 2f\n"
+        "subs r6, r6, #1\n"
+        "bne 1b\n"
+        "2:\n"
+
+        "mov %[sample1], r4\n"
+        "mov %[sample2], r4, lsr #16\n"
+        "mov %[sample3], r0\n"
+        "mov %[sample4], r0, lsr #16\n"
+        :
+            [sample1]"=r"(samples[0]),
+            [sample2]"=r"(samples[1]),
+            [sample3]"=r"(samples[2]),
+            [sample4]"=r"(samples[3])
+        :
+        :
+            "r0", "r1", "r3", "r4", "r5", "r6", "cc"
+    );
+
+    REG_DMA3CNT = 0;
+    REG_IME = ime;
+});
@@ -0,0 +1,548 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** How long it takes, once an interrupt fired, to enter its handler, the error
+** emulators checking for interrupts only between blocks of instructions make.
+**
+** The tests replace libgba's dispatcher with `irq_latency_handler`, whose
+** first instruction reads Timer 1. An HBlank DMA0 starts Timer 1, and Timer 0
+** for the timer interrupt, on the HBlank of a given scanline, so each sample is
+** the number of cycles between that HBlank and the handler reading the timer:
+**   - TIMER: Timer 0 overflows `IRQ_LATENCY_TIMER` cycles after being started.
+**   - DMA: DMA1, triggered by the same HBlank as DMA0 and running after it,
+**     completes.
+**   - HBLANK: the same HBlank.
+**   - VCOUNT: the next scanline begins.
+** Those include the time the BIOS takes to call the handler.
+**
+** While waiting for the interrupt, the CPU runs a loop from IWRAM, EWRAM or ROM,
+** with and without prefetch, or from IWRAM a loop doing an `ldm` from EWRAM, a
+** `mul` or a DMA3 transfer. Each sample first halts until scanline
+** `IRQ_LATENCY_LINE` begins, so the CPU wakes up the same number of cycles
+** before the HBlank every time, then arms the timers and enters the loop 0 to
+** 3 instructions later, to catch the interrupt at a different point in it.
+**
+** Not measured on hardware yet: build with `RECORD=1` and turn the record into
+** the rows of `expected` with `tools/goldens.py`. Until then they are reported
+** without golden, but still checked against bounds derived from the bus:
+**   - The interrupt fires between `event_min` and `event_max` cycles after
+**     Timer 1 starts.
+**   - Entering the handler takes at least `IRQ_LATENCY_DISPATCH_MIN` cycles:
+**     the exception, the BIOS dispatcher and the handler's timer read, with
+**     every access taking a single cycle.
+**   - It takes at most one iteration of the loop, the longest instruction the
+**     CPU can be running when the interrupt fires, then
+**     `IRQ_LATENCY_DISPATCH_MAX` cycles.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_systemcalls.h>
+#include <gba_timers.h>
+#include <gba_video.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(irq_latency, REPORT_SUITE_IRQ_LATENCY, "IRQ Tests", "Interrupt Latency");
+
+#define IRQ_LATENCY_SAMPLES     4
+#define IRQ_LATENCY_TIMER       64      // Cycles before Timer 0 overflows
+#define IRQ_LATENCY_DMA_UNITS   8       // Words copied by DMA1 and DMA3
+#define IRQ_LATENCY_CODE_SIZE   0x100
+#define IRQ_LATENCY_LINE        80      // Scanline the samples wake up on
+
+// Cycles between the interrupt firing and the handler reading Timer 1
+#define IRQ_LATENCY_DISPATCH_MIN    20
+#define IRQ_LATENCY_DISPATCH_MAX    40
+
+#define REG_IRQ_VECTOR          (*(u32 volatile *)0x03007FFC)
+
+// Registers of DMA `_n`: SAD, DAD and CNT
+#define REG_DMA(_n)             ((vu32 *)(REG_BASE + 0xB0 + 0xC * (_n)))
+
+/*
+** Kinds of the loops that aren't a `enum test_kind`, reported in the variant
+** instead.
+*/
+#define IRQ_LATENCY_KIND_LDM    0x10
+#define IRQ_LATENCY_KIND_MUL    0x11
+#define IRQ_LATENCY_KIND_DMA    0x12
+
+/*
+** Written by `irq_latency_handler`.
+*/
+static u32 volatile irq_latency_time;
+static u32 volatile irq_latency_done;
+
+/*
+** Read Timer 1 first, then disable every interrupt, acknowledge them and tell
+** the loop to return.
+*/
+__asm__(
+    ".pushsection .iwram, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".balign 4\n"
+    ".arm\n"
+    "irq_latency_handler:\n"
+    "mov r0, #0x04000000\n"
+    "add r2, r0, #0x100\n"
+    "ldrh r1, [r2, #0x4]\n"
+    "ldr r2, =irq_latency_time\n"
+    "str r1, [r2]\n"
+
+    // Set REG_IE to 0 and write REG_IF back
+    "add r2, r0, #0x200\n"
+    "ldr r1, [r2]\n"
+    "mov r3, #0\n"
+    "strh r3, [r2]\n"
+    "lsr r1, r1, #16\n"
+    "strh r1, [r2, #0x2]\n"
+
+    "ldr r2, =irq_latency_done\n"
+    "mov r1, #1\n"
+    "str r1, [r2]\n"
+    "bx lr\n"
+    ".ltorg\n"
+    ".popsection\n"
+);
+
+extern u8 const irq_latency_handler[];
+
+/*
+** Loops waiting for `irq_latency_done`, given in r0. They only use relative
+** addressing, so they can be copied together anywhere.
+**
+** `irq_latency_phase` runs r1 `nop`s, from 0 to 3, before the loop begins.
+*/
+__asm__(
+    ".pushsection .text.irq_latency, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".balign 4\n"
+    ".arm\n"
+
+    ".macro irq_latency_phase\n"
+    "rsb r1, r1, #3\n"
+    "add pc, pc, r1, lsl #2\n"
+    "nop\n"
+    "nop\n"
+    "nop\n"
+    "nop\n"
+    ".endm\n"
+
+    "irq_latency_code:\n"
+
+    "irq_latency_wait:\n"
+    "irq_latency_phase\n"
+    "1:\n"
+    "ldr r12, [r0]\n"
+    "cmp r12, #0\n"
+    "beq 1b\n"
+    "bx lr\n"
+
+    // Load 8 words from r2
+    "irq_latency_wait_ldm:\n"
+    "push {r4-r11}\n"
+    "irq_latency_phase\n"
+    "1:\n"
+    "ldm r2, {r4-r11}\n"
+    "ldr r12, [r0]\n"
+    "cmp r12, #0\n"
+    "beq 1b\n"
+    "pop {r4-r11}\n"
+    "bx lr\n"
+
+    // Multiply r2 by itself
+    "irq_latency_wait_mul:\n"
+    "irq_latency_phase\n"
+    "1:\n"
+    "mul r3, r2, r2\n"
+    "ldr r12, [r0]\n"
+    "cmp r12, #0\n"
+    "beq 1b\n"
+    "bx lr\n"
+
+    // Write r3 to r2, REG_DMA3CNT
+    "irq_latency_wait_dma:\n"
+    "irq_latency_phase\n"
+    "1:\n"
+    "str r3, [r2]\n"
+    "nop\n"
+    "nop\n"
+    "ldr r12, [r0]\n"
+    "cmp r12, #0\n"
+    "beq 1b\n"
+    "bx lr\n"
+
+    "irq_latency_code_end:\n"
+    ".popsection\n"
+);
+
+extern u8 const irq_latency_code[];
+extern u8 const irq_latency_code_end[];
+extern u8 const irq_latency_wait[];
+extern u8 const irq_latency_wait_ldm[];
+extern u8 const irq_latency_wait_mul[];
+extern u8 const irq_latency_wait_dma[];
+
+typedef void (*irq_latency_wait_t)(u32 volatile *done, u32 phase, u32 arg0, u32 arg1);
+
+struct irq_latency_test {
+    char const *name;
+    u16 irq;
+    s16 event_min;      // Cycles between Timer 1 starting and the interrupt
+    s16 event_max;
+};
+
+struct irq_latency_loop {
+    char const *name;
+    u16 kind;
+    u8 const *wait;     // One of the loops, in ROM
+    u16 iteration;      // Cycles of an iteration, every access non-sequential
+};
+
+/*
+** With WAITCNT set to 0, an ARM fetch takes 1 cycle from IWRAM, 6 from EWRAM
+** and 8 from ROM. The `ldr`, `cmp` and `beq` of each loop take 3 fetches, a
+** read from IWRAM and an internal cycle. The `ldm` adds 8 reads from EWRAM,
+** the `mul` 4 internal cycles, and the DMA3 transfer stalls the CPU for about
+** 20 cycles.
+*/
+static struct irq_latency_loop const irq_latency_loops[] = {
+    { "IWRAM",          TEST_KIND_IWRAM,                irq_latency_wait,       8 },
+    { "EWRAM",          TEST_KIND_EWRAM,                irq_latency_wait,       32 },
+    { "ROM",            TEST_KIND_ROM_WITHOUT_PREFETCH, irq_latency_wait,       42 },
+    { "ROM PREFETCH",   TEST_KIND_ROM_WITH_PREFETCH,    irq_latency_wait,       42 },
+    { "LDM",            IRQ_LATENCY_KIND_LDM,           irq_latency_wait_ldm,   57 },
+    { "MUL",            IRQ_LATENCY_KIND_MUL,           irq_latency_wait_mul,   12 },
+    { "DMA",            IRQ_LATENCY_KIND_DMA,           irq_latency_wait_dma,   40 },
+};
+
+#define IRQ_LATENCY_LOOPS       (sizeof(irq_latency_loops) / sizeof(irq_latency_loops[0]))
+#define IRQ_LATENCY_TESTS       4
+
+/*
+** Cycles between the HBlank and the handler, for each loop.
+*/
+static u32 const expected[IRQ_LATENCY_TESTS][IRQ_LATENCY_LOOPS][IRQ_LATENCY_SAMPLES] = {
+    { { 0 } },
+};
+
+static u32 irq_latency_iwram[IRQ_LATENCY_CODE_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 irq_latency_ewram[IRQ_LATENCY_CODE_SIZE / sizeof(u32)];
+
+static u32 irq_latency_timers[2];
+static u32 irq_latency_src[IRQ_LATENCY_DMA_UNITS];
+static u32 irq_latency_dst[IRQ_LATENCY_DMA_UNITS];
+EWRAM_BSS static u32 irq_latency_ldm[8];
+
+/*
+** Copy the loops where `loop` runs from, and return where its loop begins.
+*/
+static
+irq_latency_wait_t
+irq_latency_place(
+    struct irq_latency_loop const *loop
+) {
+    u32 const *src;
+    u32 *dst;
+    u32 i;
+
+    switch (loop->kind) {
+        case TEST_KIND_ROM_WITHOUT_PREFETCH:
+        case TEST_KIND_ROM_WITH_PREFETCH:   return (irq_latency_wait_t)loop->wait;
+        case TEST_KIND_EWRAM:               dst = irq_latency_ewram; break;
+        default:                            dst = irq_latency_iwram; break;
+    }
+
+    src = (u32 const *)irq_latency_code;
+    for (i = 0; i < (u32)(irq_latency_code_end - irq_latency_code) / sizeof(u32); ++i) {
+        dst[i] = src[i];
+    }
+    return (irq_latency_wait_t)((u8 *)dst + (loop->wait - irq_latency_code));
+}
+
+/*
+** Arm the interrupt of `irq` and the HBlank DMAs starting the timers.
+*/
+IWRAM_CODE
+static
+void
+irq_latency_arm(
+    u16 irq
+) {
+    irq_latency_timers[0] = 0;
+    irq_latency_timers[1] = TIMER_START << 16;
+
+    switch (irq) {
+        case IRQ_TIMER0: {
+            irq_latency_timers[0] = (0x10000 - IRQ_LATENCY_TIMER) | ((TIMER_START | TIMER_IRQ) << 16);
+            break;
+        }
+        case IRQ_DMA1: {
+            REG_DMA(1)[0] = (u32)irq_latency_src;
+            REG_DMA(1)[1] = (u32)irq_latency_dst;
+            REG_DMA(1)[2] = DMA_ENABLE | DMA_IRQ | DMA_HBLANK | DMA32 | IRQ_LATENCY_DMA_UNITS;
+            break;
+        }
+        case IRQ_HBLANK: {
+            REG_DISPSTAT |= LCDC_HBL;
+            break;
+        }
+        case IRQ_VCOUNT: {
+            REG_DISPSTAT = (REG_DISPSTAT & 0xFF) | LCDC_VCNT | VCOUNT(IRQ_LATENCY_LINE + 1);
+            break;
+        }
+    }
+
+    REG_DMA(0)[0] = (u32)irq_latency_timers;
+    REG_DMA(0)[1] = (u32)&REG_TM0CNT;
+    REG_DMA(0)[2] = DMA_ENABLE | DMA_HBLANK | DMA32 | 2;
+}
+
+/*
+** Wait for an interrupt of `irq` in `loop`, entering it `phase` instructions
+** late, and return the value of Timer 1 its handler read.
+**
+** Runs from IWRAM, so everything is armed well before the next HBlank, and
+** always in the same number of cycles once the CPU wakes up.
+*/
+IWRAM_CODE
+static
+u32
+irq_latency_measure(
+    u16 irq,
+    struct irq_latency_loop const *loop,
+    irq_latency_wait_t wait,
+    u32 phase
+) {
+    u32 arg0;
+    u32 arg1;
+
+    arg0 = 0;
+    arg1 = 0;
+
+    switch (loop->kind) {
+        case IRQ_LATENCY_KIND_LDM: {
+            arg0 = (u32)irq_latency_ldm;
+            break;
+        }
+        case IRQ_LATENCY_KIND_MUL: {
+            arg0 = 0x12345678;      // 4 internal cycles
+            break;
+        }
+        case IRQ_LATENCY_KIND_DMA: {
+            REG_DMA(3)[0] = (u32)irq_latency_src;
+            REG_DMA(3)[1] = (u32)irq_latency_dst;
+            arg0 = (u32)&REG_DMA(3)[2];
+            arg1 = DMA_ENABLE | DMA32 | IRQ_LATENCY_DMA_UNITS;
+            break;
+        }
+    }
+
+    REG_TM0CNT = 0;
+    REG_TM1CNT = 0;
+    irq_latency_done = false;
+    irq_latency_time = 0;
+
+    // Wake up when scanline `IRQ_LATENCY_LINE` begins, IME being 0 the handler isn't called
+    REG_DISPSTAT = (REG_DISPSTAT & 0xFF) | LCDC_VCNT | VCOUNT(IRQ_LATENCY_LINE);
+    REG_IE = IRQ_VCOUNT;
+    REG_IF = IRQ_VCOUNT;
+    Halt();
+    REG_IF = IRQ_VCOUNT;
+
+    irq_latency_arm(irq);
+    REG_IF = irq;
+    REG_IE = irq;
+    REG_IME = 1;
+
+    wait(&irq_latency_done, phase, arg0, arg1);
+
+    REG_IME = 0;
+    REG_TM0CNT = 0;
+    REG_TM1CNT = 0;
+    REG_DMA(0)[2] = 0;
+    REG_DMA(1)[2] = 0;
+    REG_DMA(3)[2] = 0;
+
+    return irq_latency_time;
+}
+
+/*
+** Check `measured` against the bounds of `test` in `loop`, and return false
+** with the sample crossing them in `value` if one does.
+*/
+static
+bool
+irq_latency_check_bounds(
+    struct irq_latency_test const *test,
+    struct irq_latency_loop const *loop,
+    u32 const *measured,
+    u32 *value,
+    u32 *bound
+) {
+    u32 min;
+    u32 max;
+    u32 i;
+
+    min = test->event_min + IRQ_LATENCY_DISPATCH_MIN;
+    max = test->event_max + loop->iteration + IRQ_LATENCY_DISPATCH_MAX;
+
+    for (i = 0; i < IRQ_LATENCY_SAMPLES; ++i) {
+        *value = measured[i];
+        if (*value < min) {
+            *bound = min;
+            return false;
+        }
+        if (*value > max) {
+            *bound = max;
+            return false;
+        }
+    }
+    return true;
+}
+
+static
+void
+irq_latency_run(
+    struct test const *test
+) {
+    struct irq_latency_test const *itest;
+    struct irq_latency_loop const *loop;
+    irq_latency_wait_t wait;
+    u32 const *golden;
+    u32 measured[IRQ_LATENCY_SAMPLES];
+    u32 vector;
+    u32 waitcnt;
+    u16 dispstat;
+    u16 ime;
+    u16 ie;
+    u32 nb_fail;
+    u32 nb_unknown;
+    u32 failed;
+    u32 value;
+    u32 bound;
+    bool bounded;
+    bool known;
+    u32 l;
+    u32 i;
+
+    itest = test->data;
+    nb_fail = 0;
+    nb_unknown = 0;
+
+    ime = REG_IME;
+    ie = REG_IE;
+    vector = REG_IRQ_VECTOR;
+    dispstat = REG_DISPSTAT;
+    waitcnt = REG_WAITCNT;
+
+    REG_IME = 0;
+    REG_IRQ_VECTOR = (u32)irq_latency_handler;
+
+    log_puts(itest->name);
+
+    for (l = 0; l < IRQ_LATENCY_LOOPS; ++l) {
+        loop = &irq_latency_loops[l];
+        golden = expected[test->idx - 1][l];
+        wait = irq_latency_place(loop);
+
+        REG_WAITCNT = (loop->kind == TEST_KIND_ROM_WITH_PREFETCH) ? WAITCNT_PREFETCH : 0;
+        for (i = 0; i < IRQ_LATENCY_SAMPLES; ++i) {
+            measured[i] = irq_latency_measure(itest->irq, loop, wait, i);
+            REG_DISPSTAT = dispstat;
+        }
+        REG_WAITCNT = waitcnt;
+
+        bounded = irq_latency_check_bounds(itest, loop, measured, &value, &bound);
+
+        report_begin(REPORT_SUITE_IRQ_LATENCY, test->idx, loop->kind);
+        failed = IRQ_LATENCY_SAMPLES;
+        known = false;
+        for (i = 0; i < IRQ_LATENCY_SAMPLES; ++i) {
+            report_sample(measured[i], golden[i]);
+            known |= !!golden[i];
+            if (measured[i] != golden[i] && failed == IRQ_LATENCY_SAMPLES) {
+                failed = i;
+            }
+        }
+
+        // A crossed bound is reported as an extra sample, and fails the test even without golden
+        if (!bounded) {
+            report_sample(value, bound);
+        } else if (!known) {
+            report_unknown();
+            ++nb_unknown;
+        }
+
+        if (report_end()) {
+            continue;
+        }
+
+        if (!nb_fail++) {
+            log_puts(": FAIL\n");
+        }
+
+        log_puts("    ");
+        log_puts(loop->name);
+
+        if (!bounded) {
+            log_puts(": FAIL BOUND 0x");
+            log_hex(value, 4);
+            log_puts(" / 0x");
+            log_hex(bound, 4);
+            log_putc('\n');
+            continue;
+        }
+
+        log_puts(": FAIL #");
+        log_dec(failed, 0);
+        log_puts(" 0x");
+        log_hex(measured[failed], 4);
+        log_puts(" != 0x");
+        log_hex(golden[failed], 4);
+        log_putc('\n');
+    }
+
+    REG_IF = 0xFFFF;
+    REG_IRQ_VECTOR = vector;
+    REG_IE = ie;
+    REG_IME = ime;
+
+    if (!nb_fail) {
+        log_puts(": " REPORT_PASS_STR);
+        if (!RECORD && nb_unknown) {
+            log_puts(" (");
+            log_dec(nb_unknown, 0);
+            log_puts(" without golden)");
+        }
+        log_putc('\n');
+    }
+}
+
+#define NEW_TEST(_idx, _name, _irq, _min, _max)                             \
+    static struct irq_latency_test const test_##_idx = {                    \
+        _name, _irq, _min, _max                                             \
+    };                                                                      \
+    static_assert((_idx) <= IRQ_LATENCY_TESTS);                             \
+    REGISTER_TEST(irq_latency, _idx, TEST_KIND_IWRAM, irq_latency_run, &test_##_idx);
+
+/*
+** - Timer 0 starts one write before Timer 1.
+** - DMA1 waits for DMA0 to finish, then reads and writes IWRAM once per unit.
+** - The HBlank fires before DMA0 even starts the timers.
+** - The scanline begins 226 cycles after the HBlank flag is set, 272 after the
+**   end of HDraw.
+*/
+NEW_TEST(1, "TIMER",    IRQ_TIMER0, IRQ_LATENCY_TIMER - 4,          IRQ_LATENCY_TIMER)
+NEW_TEST(2, "DMA",      IRQ_DMA1,   2 * IRQ_LATENCY_DMA_UNITS,      2 * IRQ_LATENCY_DMA_UNITS + 8)
+NEW_TEST(3, "HBLANK",   IRQ_HBLANK, -12,                            0)
+NEW_TEST(4, "VCOUNT",   IRQ_VCOUNT, 226 - 12,                       272)
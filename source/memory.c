@@ -0,0 +1,466 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Mirrors and access widths, the rules emulators mapping memory through page
+** tables get wrong.
+**
+**   - EWRAM is mirrored every 256KB, IWRAM every 32KB, the palette and OAM
+**     every 1KB up to the end of their region.
+**   - VRAM is mirrored every 128KB, and its last 32KB mirror the 32KB before
+**     them, 0x06018000 being 0x06010000.
+**   - The ROM is mirrored in each waitstate region.
+**   - 8-bit writes to the palette, and to the BG part of VRAM, write the byte
+**     to both halves of the halfword. They are ignored in OAM and in the OBJ
+**     part of VRAM, which starts at 0x06010000 in modes 0 to 2 and 0x06014000
+**     in modes 3 to 5.
+**   - Misaligned 32-bit reads are rotated, and so are 16-bit reads from an
+**     odd address. Misaligned writes ignore the lowest bits of the address.
+**
+** Every access goes through one of the routines below, run in ARM and in
+** THUMB.
+*/
+
+#include <gba_interrupt.h>
+#include <gba_video.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(memory, REPORT_SUITE_MEMORY, "Memory Tests", "Mirrors & Access Widths");
+
+#define MEMORY_MAX_SAMPLES  6
+
+/*
+** Loads and stores of every width, in IWRAM.
+*/
+__asm__(
+    ".pushsection .iwram, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".balign 4\n"
+    ".arm\n"
+    "memory_arm_ldr:\n"
+    "ldr r0, [r0]\n"
+    "bx lr\n"
+    "memory_arm_ldrh:\n"
+    "ldrh r0, [r0]\n"
+    "bx lr\n"
+    "memory_arm_ldrb:\n"
+    "ldrb r0, [r0]\n"
+    "bx lr\n"
+    "memory_arm_str:\n"
+    "str r1, [r0]\n"
+    "bx lr\n"
+    "memory_arm_strh:\n"
+    "strh r1, [r0]\n"
+    "bx lr\n"
+    "memory_arm_strb:\n"
+    "strb r1, [r0]\n"
+    "bx lr\n"
+
+    ".thumb\n"
+    ".thumb_func\n"
+    "memory_thumb_ldr:\n"
+    "ldr r0, [r0]\n"
+    "bx lr\n"
+    ".thumb_func\n"
+    "memory_thumb_ldrh:\n"
+    "ldrh r0, [r0]\n"
+    "bx lr\n"
+    ".thumb_func\n"
+    "memory_thumb_ldrb:\n"
+    "ldrb r0, [r0]\n"
+    "bx lr\n"
+    ".thumb_func\n"
+    "memory_thumb_str:\n"
+    "str r1, [r0]\n"
+    "bx lr\n"
+    ".thumb_func\n"
+    "memory_thumb_strh:\n"
+    "strh r1, [r0]\n"
+    "bx lr\n"
+    ".thumb_func\n"
+    "memory_thumb_strb:\n"
+    "strb r1, [r0]\n"
+    "bx lr\n"
+
+    ".arm\n"
+    ".popsection\n"
+);
+
+u32 memory_arm_ldr(u32 addr);
+u32 memory_arm_ldrh(u32 addr);
+u32 memory_arm_ldrb(u32 addr);
+void memory_arm_str(u32 addr, u32 value);
+void memory_arm_strh(u32 addr, u32 value);
+void memory_arm_strb(u32 addr, u32 value);
+u32 memory_thumb_ldr(u32 addr);
+u32 memory_thumb_ldrh(u32 addr);
+u32 memory_thumb_ldrb(u32 addr);
+void memory_thumb_str(u32 addr, u32 value);
+void memory_thumb_strh(u32 addr, u32 value);
+void memory_thumb_strb(u32 addr, u32 value);
+
+struct memory_ops {
+    u32 (*ldr)(u32 addr);
+    u32 (*ldrh)(u32 addr);
+    u32 (*ldrb)(u32 addr);
+    void (*str)(u32 addr, u32 value);
+    void (*strh)(u32 addr, u32 value);
+    void (*strb)(u32 addr, u32 value);
+};
+
+static struct memory_ops const memory_ops[2] = {
+    {
+        memory_arm_ldr, memory_arm_ldrh, memory_arm_ldrb,
+        memory_arm_str, memory_arm_strh, memory_arm_strb,
+    },
+    {
+        memory_thumb_ldr, memory_thumb_ldrh, memory_thumb_ldrb,
+        memory_thumb_str, memory_thumb_strh, memory_thumb_strb,
+    },
+};
+
+typedef size_t (*memory_run_t)(struct memory_ops const *ops, u32 *samples, u32 *expected);
+
+struct memory_test {
+    char const *name;
+    memory_run_t run;
+    u32 addr;           // Aligned address the test works around, if any
+};
+
+static u32 memory_iwram[4];
+EWRAM_BSS static u32 memory_ewram[4];
+static u32 const memory_rom[4] = { 0x01234567, 0x89ABCDEF, 0xFEDCBA98, 0x76543210 };
+
+static
+u32
+memory_ror(
+    u32 value,
+    u32 shift
+) {
+    return shift ? (value >> shift) | (value << (32 - shift)) : value;
+}
+
+/*
+** Write a different word through the base address and each mirror, and read
+** it back through the next one.
+*/
+static
+size_t
+memory_mirrors(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected,
+    u32 const *mirrors,
+    size_t nb_mirrors
+) {
+    size_t i;
+
+    for (i = 0; i < nb_mirrors; ++i) {
+        expected[i] = 0xC0DE0000 | (i << 8) | mirrors[i] >> 24;
+        ops->str(mirrors[i], expected[i]);
+        samples[i] = ops->ldr(mirrors[(i + 1) % nb_mirrors]);
+    }
+    return nb_mirrors;
+}
+
+static
+size_t
+memory_run_ewram(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    u32 addr;
+    u32 mirrors[4];
+
+    addr = (u32)memory_ewram;
+    mirrors[0] = addr;
+    mirrors[1] = addr + 0x40000;
+    mirrors[2] = addr + 0x80000;
+    mirrors[3] = addr + 0xFC0000;
+    return memory_mirrors(ops, samples, expected, mirrors, 4);
+}
+
+static
+size_t
+memory_run_iwram(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    u32 addr;
+    u32 mirrors[4];
+
+    addr = (u32)memory_iwram;
+    mirrors[0] = addr;
+    mirrors[1] = addr + 0x8000;
+    mirrors[2] = addr + 0x10000;
+    mirrors[3] = addr + 0xFF8000;
+    return memory_mirrors(ops, samples, expected, mirrors, 4);
+}
+
+/*
+** The end of OBJ VRAM, mirrored by the last 32KB of each 128KB block.
+*/
+static
+size_t
+memory_run_vram(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    static u32 const mirrors[4] = { 0x06017FF0, 0x0601FFF0, 0x06037FF0, 0x06FFFFF0 };
+
+    return memory_mirrors(ops, samples, expected, mirrors, 4);
+}
+
+static
+size_t
+memory_run_pal_oam(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    static u32 const pal[3] = { 0x050003F0, 0x050007F0, 0x05FFFFF0 };
+    static u32 const oam[3] = { 0x070003F0, 0x070007F0, 0x07FFFFF0 };
+
+    memory_mirrors(ops, samples, expected, pal, 3);
+    memory_mirrors(ops, samples + 3, expected + 3, oam, 3);
+    return 6;
+}
+
+static
+size_t
+memory_run_rom(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    u32 addr;
+    size_t i;
+
+    addr = (u32)&memory_rom[1];
+    for (i = 0; i < 3; ++i) {
+        samples[i] = ops->ldr(addr + 0x02000000 * i);
+        expected[i] = memory_rom[1];
+    }
+    samples[3] = ops->ldrh(addr + 0x04000002);
+    expected[3] = memory_rom[1] >> 16;
+    return 4;
+}
+
+/*
+** Write a byte to each half of a halfword, and read the halfword back.
+*/
+static
+void
+memory_store8(
+    struct memory_ops const *ops,
+    u32 addr,
+    u32 *samples
+) {
+    *(vu16 *)addr = 0x1234;
+    ops->strb(addr, 0xAB);
+    samples[0] = *(vu16 *)addr;
+
+    *(vu16 *)addr = 0x1234;
+    ops->strb(addr + 1, 0xCD);
+    samples[1] = *(vu16 *)addr;
+}
+
+static
+size_t
+memory_run_pal_store8(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    memory_store8(ops, 0x050003F0, samples);
+    expected[0] = 0xABAB;
+    expected[1] = 0xCDCD;
+    return 2;
+}
+
+static
+size_t
+memory_run_oam_store8(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    memory_store8(ops, 0x070003F0, samples);
+    expected[0] = 0x1234;
+    expected[1] = 0x1234;
+    return 2;
+}
+
+/*
+** Write a byte to the BG part of VRAM and to the OBJ part, in mode 0, then
+** in mode 3, around 0x06014000, with the display blanked.
+*/
+static
+size_t
+memory_run_vram_store8(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected
+) {
+    u16 dispcnt;
+    u32 half[2];
+
+    dispcnt = REG_DISPCNT;
+
+    memory_store8(ops, 0x06008000, half);
+    samples[0] = half[0] | (half[1] << 16);
+    memory_store8(ops, 0x06012000, half);
+    samples[1] = half[0] | (half[1] << 16);
+
+    REG_DISPCNT = MODE_3 | LCDC_OFF;
+    memory_store8(ops, 0x06012000, half);
+    samples[2] = half[0] | (half[1] << 16);
+    memory_store8(ops, 0x06014000, half);
+    samples[3] = half[0] | (half[1] << 16);
+    REG_DISPCNT = dispcnt;
+
+    expected[0] = 0xCDCDABAB;
+    expected[1] = 0x12341234;
+    expected[2] = 0xCDCDABAB;
+    expected[3] = 0x12341234;
+    return 4;
+}
+
+/*
+** Read a word at every misalignment, and a halfword at an odd address, then
+** write a word and a halfword at misaligned addresses.
+*/
+static
+size_t
+memory_misaligned(
+    struct memory_ops const *ops,
+    u32 addr,
+    bool writable,
+    u32 *samples,
+    u32 *expected
+) {
+    u32 word;
+    u32 i;
+
+    if (writable) {
+        *(vu32 *)addr = 0x89ABCDEF;
+    }
+    word = *(vu32 *)addr;
+
+    for (i = 0; i < 3; ++i) {
+        samples[i] = ops->ldr(addr + 1 + i);
+        expected[i] = memory_ror(word, 8 * (1 + i));
+    }
+    samples[3] = ops->ldrh(addr + 1);
+    expected[3] = memory_ror(word & 0xFFFF, 8);
+
+    if (!writable) {
+        return 4;
+    }
+
+    // Clear the halfword's word, so a store writing nothing, or writing the
+    // other halfword, doesn't find the previous run's value there
+    *(vu32 *)(addr + 4) = 0;
+
+    ops->str(addr + 3, 0x13579BDF);
+    ops->strh(addr + 5, 0x2468);
+    samples[4] = *(vu32 *)addr;
+    expected[4] = 0x13579BDF;
+    samples[5] = *(vu32 *)(addr + 4);
+    expected[5] = 0x00002468;
+    return 6;
+}
+
+static
+size_t
+memory_run_misaligned(
+    struct memory_ops const *ops,
+    u32 *samples,
+    u32 *expected,
+    u32 addr
+) {
+    return memory_misaligned(ops, addr, addr < 0x08000000, samples, expected);
+}
+
+static
+void
+memory_run(
+    struct test const *test
+) {
+    struct memory_test const *mtest;
+    u32 samples[MEMORY_MAX_SAMPLES];
+    u32 expected[MEMORY_MAX_SAMPLES];
+    size_t nb_samples;
+    size_t failed;
+    u32 thumb;
+    u16 ime;
+    size_t i;
+
+    mtest = test->data;
+
+    for (thumb = 0; thumb < 2; ++thumb) {
+        ime = REG_IME;
+        REG_IME = 0;
+        if (mtest->addr) {
+            nb_samples = memory_run_misaligned(&memory_ops[thumb], samples, expected, mtest->addr);
+        } else {
+            nb_samples = mtest->run(&memory_ops[thumb], samples, expected);
+        }
+        REG_IME = ime;
+
+        report_begin(REPORT_SUITE_MEMORY, test->idx, TEST_KIND_IWRAM | (thumb ? 0x80 : 0));
+        failed = nb_samples;
+        for (i = 0; i < nb_samples; ++i) {
+            report_sample(samples[i], expected[i]);
+            if (samples[i] != expected[i] && failed == nb_samples) {
+                failed = i;
+            }
+        }
+
+        log_puts(mtest->name);
+        log_puts(thumb ? " THUMB" : " ARM");
+        if (report_end()) {
+            log_puts(": " REPORT_PASS_STR "\n");
+            continue;
+        }
+
+        log_puts(": FAIL #");
+        log_dec(failed, 0);
+        log_puts(" 0x");
+        log_hex(samples[failed], 8);
+        log_puts(" != 0x");
+        log_hex(expected[failed], 8);
+        log_putc('\n');
+    }
+}
+
+#define NEW_TEST(_idx, ...)                                                 \
+    static struct memory_test const test_##_idx = { __VA_ARGS__ };          \
+    REGISTER_TEST(memory, _idx, TEST_KIND_IWRAM, memory_run, &test_##_idx);
+
+NEW_TEST(1, .name = "EWRAM MIRRORS", .run = memory_run_ewram)
+NEW_TEST(2, .name = "IWRAM MIRRORS", .run = memory_run_iwram)
+NEW_TEST(3, .name = "VRAM MIRRORS", .run = memory_run_vram)
+NEW_TEST(4, .name = "PAL/OAM MIRRORS", .run = memory_run_pal_oam)
+NEW_TEST(5, .name = "ROM MIRRORS", .run = memory_run_rom)
+NEW_TEST(6, .name = "PAL 8-BIT", .run = memory_run_pal_store8)
+NEW_TEST(7, .name = "VRAM 8-BIT", .run = memory_run_vram_store8)
+NEW_TEST(8, .name = "OAM 8-BIT", .run = memory_run_oam_store8)
+
+NEW_TEST(9, .name = "EWRAM MISALIGNED", .addr = (u32)memory_ewram)
+NEW_TEST(10, .name = "IWRAM MISALIGNED", .addr = (u32)memory_iwram)
+NEW_TEST(11, .name = "PAL MISALIGNED", .addr = 0x050003F0)
+NEW_TEST(12, .name = "VRAM MISALIGNED", .addr = 0x06017FF0)
+NEW_TEST(13, .name = "OAM MISALIGNED", .addr = 0x070003F0)
+NEW_TEST(14, .name = "ROM MISALIGNED", .addr = (u32)memory_rom)
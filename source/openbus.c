@@ -0,0 +1,376 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Reads from unmapped regions, the case emulators mapping memory through page
+** tables get wrong outside of the BIOS.
+**
+** Each test reads one address, and the three following ones, 32, 16 and 8
+** bits at a time, from ARM and THUMB routines running from IWRAM, EWRAM, ROM,
+** VRAM and OAM.
+**
+** Unmapped regions return the opcode the CPU fetched last. Relative to `$`,
+** the address of the load:
+**   - In ARM, the word at `$+8`.
+**   - In THUMB, from EWRAM, the palette, VRAM or ROM, the halfword at `$+4`,
+**     twice.
+**   - In THUMB, from the BIOS or OAM, the halfwords at `$+4` and `$+6`, or at
+**     `$+2` and `$+4` if `$` isn't word-aligned.
+**   - In THUMB, from IWRAM, the halfwords at `$+4` and `$+2`, or at `$+2` and
+**     `$+4` if `$` isn't word-aligned.
+** The GamePak returns instead the address of the halfword read, divided by 2,
+** past the end of the ROM, and SRAM returns the byte read on every byte lane.
+**
+** Like any other read, misaligned 32-bit reads are rotated, and so are 16-bit
+** reads from an odd address.
+**
+** The expected values are computed from the opcodes of the routine where it
+** was copied.
+*/
+
+#include <gba_interrupt.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(openbus, REPORT_SUITE_OPENBUS, "Open Bus Tests", "Unmapped Regions");
+
+#define OPENBUS_READS           12
+#define OPENBUS_BUFFER_SIZE     0x80
+
+/*
+** Kinds of the placements that aren't a `enum test_kind`, reported in the
+** variant instead.
+*/
+#define OPENBUS_KIND_VRAM       0x10
+#define OPENBUS_KIND_OAM        0x11
+
+/*
+** Routines reading `addr` to `addr + 3` and storing the values in `out`.
+**
+** Read `i` is `(i % 3) ? (i % 3 == 1 ? 16 : 8) : 32` bits wide, from
+** `addr + i / 3`. Its load is `OPENBUS_*_LOAD(i)` bytes after the beginning
+** of the routine.
+*/
+__asm__(
+    ".pushsection .text.openbus, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".balign 4\n"
+    ".arm\n"
+    "openbus_arm:\n"
+    "mov r2, r0\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #0]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #4]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #8]\n"
+    "add r1, r1, #1\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #12]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #16]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #20]\n"
+    "add r1, r1, #1\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #24]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #28]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #32]\n"
+    "add r1, r1, #1\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #36]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #40]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #44]\n"
+    "add r1, r1, #1\n"
+
+    "bx lr\n"
+    "openbus_arm_end:\n"
+
+    ".balign 4\n"
+    ".thumb\n"
+    "openbus_thumb:\n"
+    "movs r2, r0\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #0]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #4]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #8]\n"
+    "adds r1, #1\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #12]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #16]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #20]\n"
+    "adds r1, #1\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #24]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #28]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #32]\n"
+    "adds r1, #1\n"
+
+    "ldr r0, [r1]\n"
+    "str r0, [r2, #36]\n"
+    "ldrh r0, [r1]\n"
+    "str r0, [r2, #40]\n"
+    "ldrb r0, [r1]\n"
+    "str r0, [r2, #44]\n"
+    "adds r1, #1\n"
+
+    "bx lr\n"
+    "openbus_thumb_end:\n"
+
+    ".arm\n"
+    ".popsection\n"
+);
+
+extern u8 const openbus_arm[];
+extern u8 const openbus_arm_end[];
+extern u8 const openbus_thumb[];
+extern u8 const openbus_thumb_end[];
+
+#define OPENBUS_ARM_LOAD(_i)    (4 + 28 * ((_i) / 3) + 8 * ((_i) % 3))
+#define OPENBUS_THUMB_LOAD(_i)  (2 + 14 * ((_i) / 3) + 4 * ((_i) % 3))
+
+typedef void (*openbus_code_t)(u32 *out, u32 addr);
+
+struct openbus_place {
+    char const *name;
+    u16 kind;
+    u32 addr;           // Where the routines are copied, 0 to run them from ROM
+};
+
+static u32 openbus_iwram[OPENBUS_BUFFER_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 openbus_ewram[OPENBUS_BUFFER_SIZE / sizeof(u32)];
+
+/*
+** VRAM and OAM are copied to where OBJs, which are off, would be.
+*/
+static struct openbus_place const openbus_places[] = {
+    { "IWRAM",  TEST_KIND_IWRAM,                (u32)openbus_iwram },
+    { "EWRAM",  TEST_KIND_EWRAM,                (u32)openbus_ewram },
+    { "ROM",    TEST_KIND_ROM_WITHOUT_PREFETCH, 0 },
+    { "VRAM",   OPENBUS_KIND_VRAM,              0x06014000 },
+    { "OAM",    OPENBUS_KIND_OAM,               0x07000000 },
+};
+
+#define OPENBUS_PLACES          (sizeof(openbus_places) / sizeof(openbus_places[0]))
+
+/*
+** Copy the routine to `place`, 32 bits at a time for VRAM and OAM, and return
+** where it begins.
+*/
+static
+u8 const *
+openbus_place(
+    struct openbus_place const *place,
+    bool thumb
+) {
+    u32 const *src;
+    u32 const *end;
+    vu32 *dst;
+
+    src = (u32 const *)(thumb ? openbus_thumb : openbus_arm);
+    end = (u32 const *)(thumb ? openbus_thumb_end : openbus_arm_end);
+
+    if (!place->addr) {
+        return (u8 const *)src;
+    }
+
+    for (dst = (vu32 *)place->addr; src < end; ++src, ++dst) {
+        *dst = *src;
+    }
+    return (u8 const *)place->addr;
+}
+
+static
+u32
+openbus_ror(
+    u32 value,
+    u32 shift
+) {
+    return shift ? (value >> shift) | (value << (32 - shift)) : value;
+}
+
+/*
+** Return the value of the bus during load `load` of a routine.
+*/
+static
+u32
+openbus_prefetch(
+    u8 const *load,
+    bool thumb
+) {
+    u16 const *half;
+    bool aligned;
+
+    if (!thumb) {
+        return *(u32 const *)(load + 8);
+    }
+
+    half = (u16 const *)load;
+    aligned = !((u32)load & 2);
+
+    switch ((u32)load >> 24) {
+        case 0x0:
+        case 0x7:   return aligned ? half[2] | (half[3] << 16) : half[1] | (half[2] << 16);
+        case 0x3:   return aligned ? half[2] | (half[1] << 16) : half[1] | (half[2] << 16);
+        default:    return half[2] | (half[2] << 16);
+    }
+}
+
+/*
+** Return the value of read `i` of `addr`, given the value of the bus during
+** its load.
+*/
+static
+u32
+openbus_expected(
+    u32 addr,
+    u32 i,
+    u32 bus
+) {
+    u32 align;
+    u32 half;
+
+    align = i / 3;
+
+    switch (addr >> 24) {
+        case 0x8: case 0x9:
+        case 0xA: case 0xB:
+        case 0xC: case 0xD: {
+            half = (addr >> 1) & 0xFFFF;
+            bus = half | ((half + 1) << 16);
+            break;
+        }
+        case 0xE: {
+            bus = *(vu8 *)(addr + align) * 0x01010101;
+            break;
+        }
+    }
+
+    switch (i % 3) {
+        case 0:     return openbus_ror(bus, 8 * align);
+        case 1: {
+            half = (bus >> (8 * (align & 2))) & 0xFFFF;
+            return openbus_ror(half, 8 * (align & 1));
+        }
+        default:    return (bus >> (8 * align)) & 0xFF;
+    }
+}
+
+static
+void
+openbus_run(
+    struct test const *test
+) {
+    struct openbus_place const *place;
+    openbus_code_t code;
+    u8 const *base;
+    u32 values[OPENBUS_READS];
+    u32 expected[OPENBUS_READS];
+    u32 addr;
+    u32 nb_fail;
+    u32 failed;
+    bool thumb;
+    u32 load;
+    u32 p;
+    u32 s;
+    u32 i;
+    u32 waitcnt;
+    u16 ime;
+
+    addr = (u32)test->data;
+    nb_fail = 0;
+
+    // Give each byte of SRAM read a different value
+    for (i = 0; i < 4; ++i) {
+        *(vu8 *)(0x0E007FE0 + i) = 0x11 * (i + 1);
+    }
+
+    log_puts("0x");
+    log_hex(addr, 8);
+
+    for (p = 0; p < OPENBUS_PLACES; ++p) {
+        place = &openbus_places[p];
+
+        for (s = 0; s < 2; ++s) {
+            thumb = s;
+            base = openbus_place(place, thumb);
+            code = (openbus_code_t)((u32)base | thumb);
+
+            // The prefetcher would change what the ROM's reads see
+            ime = REG_IME;
+            waitcnt = REG_WAITCNT;
+            REG_IME = 0;
+            REG_WAITCNT = waitcnt & ~WAITCNT_PREFETCH;
+            code(values, addr);
+            REG_WAITCNT = waitcnt;
+            REG_IME = ime;
+
+            report_begin(REPORT_SUITE_OPENBUS, test->idx, place->kind | (thumb ? 0x80 : 0));
+            failed = OPENBUS_READS;
+            for (i = 0; i < OPENBUS_READS; ++i) {
+                load = thumb ? OPENBUS_THUMB_LOAD(i) : OPENBUS_ARM_LOAD(i);
+                expected[i] = openbus_expected(addr, i, openbus_prefetch(base + load, thumb));
+                report_sample(values[i], expected[i]);
+                if (values[i] != expected[i] && failed == OPENBUS_READS) {
+                    failed = i;
+                }
+            }
+
+            if (report_end()) {
+                continue;
+            }
+
+            if (!nb_fail++) {
+                log_puts(": FAIL\n");
+            }
+
+            log_puts("    ");
+            log_puts(place->name);
+            log_puts(thumb ? " THUMB" : " ARM");
+            log_puts(": FAIL +");
+            log_dec(failed / 3, 0);
+            log_puts((failed % 3) ? ((failed % 3 == 1) ? " 16 0x" : " 8 0x") : " 32 0x");
+            log_hex(values[failed], 8);
+            log_puts(" != 0x");
+            log_hex(expected[failed], 8);
+            log_putc('\n');
+        }
+    }
+
+    if (!nb_fail) {
+        log_puts(": " REPORT_PASS_STR "\n");
+    }
+}
+
+#define NEW_TEST(_idx, _addr)                                               \
+    REGISTER_TEST(openbus, _idx, TEST_KIND_IWRAM, openbus_run, (void const *)(_addr));
+
+NEW_TEST(1, 0x00004000)     // Past the BIOS
+NEW_TEST(2, 0x04000FF0)     // Past the I/O registers
+NEW_TEST(3, 0x10000000)     // Past the address space
+NEW_TEST(4, 0x09FFFFF0)     // Past the end of the ROM, in WS0
+NEW_TEST(5, 0x0E007FE0)     // SRAM, past the test selection
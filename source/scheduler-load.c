@@ -0,0 +1,485 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Every timer, DMA and display interrupt active at once, for `LOAD_FRAMES`
+** frames.
+**
+**   - Timer 0 overflows every 1024 cycles and feeds FIFO A, Timer 1 every 2048
+**     cycles and feeds FIFO B, Timer 2 counts 16 of Timer 1's overflows and
+**     Timer 3 overflows every 16384 cycles.
+**   - DMA0 copies Timer 0's counter on every HBlank, DMA1 and DMA2 refill the
+**     FIFOs, and DMA3 copies a block on every VBlank and, from the VCOUNT
+**     handler, once immediately every frame.
+**   - Every one of them raises an interrupt, as do HBlank, VBlank and VCOUNT.
+**
+** Each interrupt handler logs its source and the current scanline. The log is
+** cut in frames at each VBlank, and each frame is reported as a variant of the
+** test with the hash and the length of its part of the log. The whole log,
+** including the events after the last VBlank, is reported as variant
+** `LOAD_FRAMES`, with the number of events that didn't fit in it. The sources
+** of the events are also written to SRAM, in order, at `REPORT_LOG_SRAM_ADDR`:
+** a `struct load_log` followed by 4 bits per event, the first one of each byte
+** in its lower bits.
+**
+** The suite doubles as a benchmark: it is the heaviest load a game
+** realistically puts on an emulator's scheduler.
+**
+** Each frame must hold as many events of each source as its length allows:
+** 228 HBlanks, 160 HBlank DMAs, a VBlank, a VCOUNT match, two copies of DMA3,
+** and as many overflows and refills as the timers' periods fit in 280896
+** cycles. The latency of the handlers can move an event to the next frame, so
+** one event more or less is tolerated. The FIFOs start empty, so the first
+** frame gets two more refills of each.
+**
+** The hashes aren't checked yet. The order of the events and the scanline each
+** is logged on depend on the latency of the BIOS, of libgba's dispatcher and
+** of every handler, as the interrupts pile up, so they can't be derived like
+** the counts. They can only be measured, with a `RECORD=1` build, on hardware.
+** Until `expected` is filled in, frames whose counts are right are reported
+** without golden.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_sound.h>
+#include <gba_systemcalls.h>
+#include <gba_timers.h>
+#include <gba_video.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(scheduler_load, REPORT_SUITE_SCHEDULER_LOAD, "Scheduler Tests", "All Events At Once");
+
+#define LOAD_FRAMES         6
+#define LOAD_FRAME_CYCLES   280896
+#define LOAD_MAX_EVENTS     ((REPORT_LOG_SIZE - sizeof(struct load_log)) * 2)
+#define LOAD_VCOUNT         80
+#define LOAD_BLOCK_SIZE     64      // Words copied by DMA3
+
+#define LOAD_IRQS           (                                               \
+      IRQ_VBLANK | IRQ_HBLANK | IRQ_VCOUNT                                  \
+    | IRQ_TIMER0 | IRQ_TIMER1 | IRQ_TIMER2 | IRQ_TIMER3                     \
+    | IRQ_DMA0 | IRQ_DMA1 | IRQ_DMA2 | IRQ_DMA3                             \
+)
+
+#define FNV_OFFSET          0x811C9DC5
+#define FNV_PRIME           0x01000193
+
+#define LOAD_LOG_MAGIC      0x474C4448  // "HDLG"
+
+static_assert(REPORT_LOG_SRAM_ADDR + REPORT_LOG_SIZE == TEST_SELECTION_SRAM_ADDR);
+
+/*
+** Header of the log written to SRAM.
+*/
+struct load_log {
+    u32 magic;
+    u32 nb_events;      // Events following the header
+};
+
+/*
+** How many events of a source each frame holds.
+*/
+struct load_rate {
+    u16 irq;
+    u16 count;          // Events per frame, 0 if they come every `period` cycles
+    u32 period;
+    u32 first;          // Events the first frame gets on top of the others
+};
+
+static struct load_rate const load_rates[] = {
+    { IRQ_VBLANK,   1,      0,          0 },
+    { IRQ_HBLANK,   228,    0,          0 },
+    { IRQ_VCOUNT,   1,      0,          0 },
+    { IRQ_TIMER0,   0,      1024,       0 },
+    { IRQ_TIMER1,   0,      2048,       0 },
+    { IRQ_TIMER2,   0,      32768,      0 },
+    { IRQ_TIMER3,   0,      16384,      0 },
+    { IRQ_DMA0,     160,    0,          0 },
+    { IRQ_DMA1,     0,      1024 * 16,  2 },
+    { IRQ_DMA2,     0,      2048 * 16,  2 },
+    { IRQ_DMA3,     2,      0,          0 },
+};
+
+#define LOAD_RATES          (sizeof(load_rates) / sizeof(load_rates[0]))
+
+/*
+** Expected hash and number of events of each frame, and of the whole log, by
+** variant.
+**
+** Not measured on hardware yet, see above.
+*/
+static u32 const expected[LOAD_FRAMES + 1][2] = {
+    { 0 },
+};
+
+/*
+** Each event is the index of its source in REG_IF in the upper byte, and
+** REG_VCOUNT in the lower one.
+*/
+EWRAM_BSS static u16 load_events[LOAD_MAX_EVENTS];
+static u32 volatile load_nb_events;
+
+static u32 load_scratch;
+static u32 load_block[LOAD_BLOCK_SIZE];
+EWRAM_BSS static u32 load_block_copy[LOAD_BLOCK_SIZE];
+
+/*
+** Arm DMA3 to copy `load_block` on every VBlank.
+*/
+static
+void
+load_arm_dma3(
+    void
+) {
+    REG_DMA3SAD = (u32)load_block;
+    REG_DMA3DAD = (u32)load_block_copy;
+    REG_DMA3CNT = DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_VBLANK | DMA_DST_RELOAD | DMA32 | LOAD_BLOCK_SIZE;
+}
+
+#define EVENT_HANDLER(_name, _irq, ...)                                     \
+    IWRAM_CODE                                                              \
+    static                                                                  \
+    void                                                                    \
+    load_##_name##_handler(                                                 \
+        void                                                                \
+    ) {                                                                     \
+        u32 idx;                                                            \
+                                                                            \
+        idx = load_nb_events;                                               \
+        if (idx < LOAD_MAX_EVENTS) {                                        \
+            load_events[idx] = (__builtin_ctz(_irq) << 8) | REG_VCOUNT;     \
+        }                                                                   \
+        load_nb_events = idx + 1;                                           \
+        __VA_ARGS__                                                         \
+    }
+
+EVENT_HANDLER(vblank, IRQ_VBLANK)
+EVENT_HANDLER(hblank, IRQ_HBLANK)
+EVENT_HANDLER(timer0, IRQ_TIMER0)
+EVENT_HANDLER(timer1, IRQ_TIMER1)
+EVENT_HANDLER(timer2, IRQ_TIMER2)
+EVENT_HANDLER(timer3, IRQ_TIMER3)
+EVENT_HANDLER(dma0,   IRQ_DMA0)
+EVENT_HANDLER(dma1,   IRQ_DMA1)
+EVENT_HANDLER(dma2,   IRQ_DMA2)
+EVENT_HANDLER(dma3,   IRQ_DMA3)
+
+// Copy the block immediately, then re-arm DMA3 for the next VBlank.
+EVENT_HANDLER(vcount, IRQ_VCOUNT, {
+    REG_DMA3CNT = 0;
+    REG_DMA3SAD = (u32)load_block;
+    REG_DMA3DAD = (u32)load_block_copy;
+    REG_DMA3CNT = DMA_ENABLE | DMA_IMMEDIATE | DMA32 | LOAD_BLOCK_SIZE;
+    load_arm_dma3();
+})
+
+static
+void
+load_set_handlers(
+    bool enable
+) {
+    irqSet(IRQ_VBLANK, enable ? load_vblank_handler : NULL);
+    irqSet(IRQ_HBLANK, enable ? load_hblank_handler : NULL);
+    irqSet(IRQ_VCOUNT, enable ? load_vcount_handler : NULL);
+    irqSet(IRQ_TIMER0, enable ? load_timer0_handler : NULL);
+    irqSet(IRQ_TIMER1, enable ? load_timer1_handler : NULL);
+    irqSet(IRQ_TIMER2, enable ? load_timer2_handler : NULL);
+    irqSet(IRQ_TIMER3, enable ? load_timer3_handler : NULL);
+    irqSet(IRQ_DMA0, enable ? load_dma0_handler : NULL);
+    irqSet(IRQ_DMA1, enable ? load_dma1_handler : NULL);
+    irqSet(IRQ_DMA2, enable ? load_dma2_handler : NULL);
+    irqSet(IRQ_DMA3, enable ? load_dma3_handler : NULL);
+}
+
+static
+u32
+load_hash(
+    u16 const *events,
+    size_t nb_events
+) {
+    u32 hash;
+    size_t i;
+
+    hash = FNV_OFFSET;
+    for (i = 0; i < nb_events; ++i) {
+        hash = (hash ^ (events[i] & 0xFF)) * FNV_PRIME;
+        hash = (hash ^ (events[i] >> 8)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+** Check the number of events of each source in `[start, end)`, the events of
+** `frame`. Return false and set `rate`, `value` and `bound` to the first
+** source out of its bounds.
+*/
+static
+bool
+load_check_counts(
+    u16 frame,
+    size_t start,
+    size_t end,
+    struct load_rate const **rate,
+    u32 *value,
+    u32 *bound
+) {
+    u32 min;
+    u32 max;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < LOAD_RATES; ++i) {
+        *rate = &load_rates[i];
+        *value = 0;
+        for (j = start; j < end; ++j) {
+            *value += (load_events[j] >> 8) == __builtin_ctz((*rate)->irq);
+        }
+
+        if ((*rate)->count) {
+            min = (*rate)->count - 1;
+            max = (*rate)->count + 1;
+        } else {
+            min = LOAD_FRAME_CYCLES / (*rate)->period - 1;
+            max = (LOAD_FRAME_CYCLES + (*rate)->period - 1) / (*rate)->period + 1;
+        }
+        if (!frame) {
+            max += (*rate)->first;
+        }
+
+        if (*value < min || *value > max) {
+            *bound = *value < min ? min : max;
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+** Report the events in `[start, end)` as variant `variant` of `test`, and
+** return false if they don't match their golden or, for a frame, their counts.
+*/
+static
+bool
+load_report(
+    struct test const *test,
+    u16 variant,
+    size_t start,
+    size_t end,
+    u32 extra,
+    u32 *nb_unknown
+) {
+    struct load_rate const *rate;
+    u32 const *golden;
+    u32 hash;
+    u32 value;
+    u32 bound;
+    bool counted;
+
+    golden = expected[variant];
+    hash = load_hash(load_events + start, end - start);
+    counted = true;
+    if (variant < LOAD_FRAMES) {
+        counted = load_check_counts(variant, start, end, &rate, &value, &bound);
+    }
+
+    report_begin(REPORT_SUITE_SCHEDULER_LOAD, test->idx, variant);
+    report_sample(hash, golden[0]);
+    report_sample(end - start, golden[1]);
+    if (variant == LOAD_FRAMES) {
+        report_sample(extra, 0);
+    }
+
+    // A count out of its bounds is reported as an extra sample, and fails the frame even without golden
+    if (!counted) {
+        report_sample(value, bound);
+    } else if (!golden[0] && !golden[1]) {
+        report_unknown();
+        ++*nb_unknown;
+    }
+
+    if (report_end()) {
+        return true;
+    }
+
+    log_puts("FRAME ");
+    log_dec(variant, 0);
+    if (!counted) {
+        log_puts(": FAIL IRQ ");
+        log_dec(__builtin_ctz(rate->irq), 0);
+        log_puts(" COUNT ");
+        log_dec(value, 0);
+        log_puts(" / ");
+        log_dec(bound, 0);
+        log_putc('\n');
+        return false;
+    }
+
+    log_puts(": FAIL 0x");
+    log_hex(hash, 8);
+    log_puts(" != 0x");
+    log_hex(golden[0], 8);
+    log_putc('\n');
+    return false;
+}
+
+/*
+** Write the sources of the first `nb_events` events to SRAM, and the header
+** last, once they are all there.
+**
+** SRAM sits on an 8-bit bus, so it must be written one byte at a time.
+*/
+static
+void
+load_write_log(
+    size_t nb_events
+) {
+    struct load_log log;
+    u8 const *bytes;
+    vu8 *sram;
+    size_t i;
+    u8 byte;
+
+    sram = (vu8 *)(REPORT_LOG_SRAM_ADDR + sizeof(log));
+    for (i = 0; i < nb_events; i += 2) {
+        byte = load_events[i] >> 8;
+        if (i + 1 < nb_events) {
+            byte |= (load_events[i + 1] >> 8) << 4;
+        }
+        sram[i / 2] = byte;
+    }
+
+    log.magic = LOAD_LOG_MAGIC;
+    log.nb_events = nb_events;
+
+    sram = (vu8 *)REPORT_LOG_SRAM_ADDR;
+    bytes = (u8 const *)&log;
+    for (i = 0; i < sizeof(log); ++i) {
+        sram[i] = bytes[i];
+    }
+}
+
+IWRAM_CODE
+static
+void
+load_run(
+    struct test const *test
+) {
+    u32 nb_unknown;
+    u32 nb_events;
+    size_t start;
+    size_t i;
+    u16 frame;
+    u16 dispstat;
+    u16 ie;
+    bool success;
+
+    for (i = 0; i < LOAD_BLOCK_SIZE; ++i) {
+        load_block[i] = i * FNV_PRIME;
+    }
+
+    ie = REG_IE;
+    dispstat = REG_DISPSTAT;
+
+    load_set_handlers(true);
+
+    // Start everything at the same point of the frame on every run.
+    VBlankIntrWait();
+    load_nb_events = 0;
+
+    REG_SOUNDCNT_X |= SNDSTAT_ENABLE;
+    REG_SOUNDCNT_H = (
+          SNDA_R_ENABLE | SNDA_L_ENABLE | SNDA_RESET_FIFO
+        | SNDB_R_ENABLE | SNDB_L_ENABLE | SNDB_RESET_FIFO
+        | (1 << 14)     // FIFO B follows Timer 1
+    );
+
+    REG_DMA0SAD = (u32)&REG_TM0CNT_L;
+    REG_DMA0DAD = (u32)&load_scratch;
+    REG_DMA0CNT = DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_HBLANK | DMA_SRC_FIXED | DMA_DST_FIXED | DMA16 | 1;
+
+    REG_DMA1SAD = (u32)load_block;
+    REG_DMA1DAD = (u32)&REG_FIFO_A;
+    REG_DMA1CNT = DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_SPECIAL | DMA_SRC_FIXED | DMA_DST_FIXED | DMA32 | 1;
+
+    REG_DMA2SAD = (u32)load_block;
+    REG_DMA2DAD = (u32)&REG_FIFO_B;
+    REG_DMA2CNT = DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_SPECIAL | DMA_SRC_FIXED | DMA_DST_FIXED | DMA32 | 1;
+
+    load_arm_dma3();
+
+    REG_TM3CNT = 0xFF00 | ((TIMER_START | TIMER_IRQ | 1) << 16);
+    REG_TM2CNT = 0xFFF0 | ((TIMER_START | TIMER_IRQ | TIMER_COUNT) << 16);
+    REG_TM1CNT = 0xF800 | ((TIMER_START | TIMER_IRQ) << 16);
+    REG_TM0CNT = 0xFC00 | ((TIMER_START | TIMER_IRQ) << 16);
+
+    REG_DISPSTAT = (dispstat & 0xFF) | LCDC_VBL | LCDC_HBL | LCDC_VCNT | VCOUNT(LOAD_VCOUNT);
+    REG_IE = LOAD_IRQS;
+
+    for (frame = 0; frame < LOAD_FRAMES; ++frame) {
+        VBlankIntrWait();
+    }
+
+    REG_IE = ie;
+
+    REG_TM0CNT = 0;
+    REG_TM1CNT = 0;
+    REG_TM2CNT = 0;
+    REG_TM3CNT = 0;
+    REG_DMA0CNT = 0;
+    REG_DMA1CNT = 0;
+    REG_DMA2CNT = 0;
+    REG_DMA3CNT = 0;
+    REG_SOUNDCNT_H = 0;
+    REG_DISPSTAT = dispstat;
+    REG_IF = LOAD_IRQS;
+
+    load_set_handlers(false);
+
+    nb_events = load_nb_events;
+    if (nb_events > LOAD_MAX_EVENTS) {
+        nb_events = LOAD_MAX_EVENTS;
+    }
+
+    load_write_log(nb_events);
+
+    // Cut the log after each VBlank.
+    success = true;
+    nb_unknown = 0;
+    start = 0;
+    frame = 0;
+    for (i = 0; i < nb_events && frame < LOAD_FRAMES; ++i) {
+        if ((load_events[i] >> 8) == __builtin_ctz(IRQ_VBLANK)) {
+            success &= load_report(test, frame, start, i + 1, 0, &nb_unknown);
+            start = i + 1;
+            ++frame;
+        }
+    }
+
+    // Frames the log doesn't reach are reported empty.
+    for (; frame < LOAD_FRAMES; ++frame) {
+        success &= load_report(test, frame, start, start, 0, &nb_unknown);
+    }
+
+    success &= load_report(test, LOAD_FRAMES, 0, nb_events, load_nb_events - nb_events, &nb_unknown);
+
+    if (success) {
+        log_puts("LOAD: " REPORT_PASS_STR);
+        if (!RECORD && nb_unknown) {
+            log_puts(" (");
+            log_dec(nb_unknown, 0);
+            log_puts(" without golden)");
+        }
+        log_putc('\n');
+    }
+}
+
+REGISTER_TEST(scheduler_load, 1, TEST_KIND_IWRAM, load_run, NULL);
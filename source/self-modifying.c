@@ -0,0 +1,337 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Code rewritten after it already ran, the case that breaks emulators caching
+** translated or decoded code when they don't invalidate it.
+**
+** Each test copies a small routine to IWRAM or EWRAM, runs it, rewrites one
+** of its instructions and runs it again, checking which of the two versions
+** of the instruction ran.
+*/
+
+#include <string.h>
+#include <gba_dma.h>
+#include <gba_systemcalls.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(self_modifying, REPORT_SUITE_SELF_MODIFYING, "Self-Modifying Code", "Invalidation & Pipeline");
+
+#define SMC_BUFFER_SIZE     0x20    // The size of a `CpuFastSet()` block
+#define SMC_MAX_SAMPLES     3
+
+/*
+** Routines copied to the buffers, in ROM.
+**
+** `smc_*_plain` return 1, or 2 once their first instruction is rewritten to
+** `SMC_*_PLAIN_PATCH`.
+**
+** `smc_*_pipeline` write `value` at `target`, using a 32-bit store in ARM and
+** a 16-bit store in THUMB, before running three instructions that set a bit
+** each of the value they return. Writing `SMC_*_PIPELINE_PATCH` over one of
+** them sets 0x10 instead.
+**
+** The first of the three instructions is being decoded when the store
+** executes, and the second one is fetched in the store's first cycle, before
+** the write happens: rewriting them only takes effect on the next run. The
+** third one is fetched after the write.
+*/
+__asm__(
+    ".pushsection .text.smc, \"ax\", %progbits\n"
+    ".syntax unified\n"
+    ".balign 4\n"
+    ".arm\n"
+    "smc_arm_plain:\n"
+    "mov r0, #1\n"
+    "bx lr\n"
+    "smc_arm_plain_end:\n"
+
+    ".balign 4\n"
+    "smc_arm_pipeline:\n"
+    "mov r2, #0\n"
+    "str r1, [r0]\n"
+    "orr r2, r2, #0x1\n"      // Decoded during the store
+    "orr r2, r2, #0x2\n"      // Fetched during the store
+    "orr r2, r2, #0x4\n"      // Fetched after the store
+    "mov r0, r2\n"
+    "bx lr\n"
+    "smc_arm_pipeline_end:\n"
+
+    ".balign 4\n"
+    ".thumb\n"
+    "smc_thumb_plain:\n"
+    "movs r0, #1\n"
+    "bx lr\n"
+    "smc_thumb_plain_end:\n"
+
+    ".balign 4\n"
+    "smc_thumb_pipeline:\n"
+    "movs r2, #0\n"
+    "strh r1, [r0]\n"
+    "adds r2, #0x1\n"         // Decoded during the store
+    "adds r2, #0x2\n"         // Fetched during the store
+    "adds r2, #0x4\n"         // Fetched after the store
+    "movs r0, r2\n"
+    "bx lr\n"
+    "smc_thumb_pipeline_end:\n"
+
+    ".arm\n"
+    ".popsection\n"
+);
+
+extern u8 const smc_arm_plain[];
+extern u8 const smc_arm_plain_end[];
+extern u8 const smc_arm_pipeline[];
+extern u8 const smc_arm_pipeline_end[];
+extern u8 const smc_thumb_plain[];
+extern u8 const smc_thumb_plain_end[];
+extern u8 const smc_thumb_pipeline[];
+extern u8 const smc_thumb_pipeline_end[];
+
+#define SMC_ARM_PLAIN_PATCH         0xE3A00002  // mov r0, #2
+#define SMC_ARM_PIPELINE_PATCH      0xE3822010  // orr r2, r2, #0x10
+#define SMC_THUMB_PLAIN_PATCH       0x2002      // movs r0, #2
+#define SMC_THUMB_PIPELINE_PATCH    0x3210      // adds r2, #0x10
+
+typedef u32 (*smc_code_t)(u32 *target, u32 value);
+
+/*
+** How `smc_rewrite()` rewrites the first instruction of the routine.
+**
+** Stores, DMAs and `CpuSet()` only write the unit holding the changed byte,
+** `CpuFastSet()` writes the whole buffer.
+*/
+enum smc_method {
+    SMC_STORE8,
+    SMC_STORE16,
+    SMC_STORE32,
+    SMC_DMA16,
+    SMC_DMA32,
+    SMC_CPUSET,
+    SMC_CPUFASTSET,
+};
+
+struct smc_test {
+    u8 const *code;
+    u8 const *code_end;
+    bool thumb;
+    enum smc_method method;     // `smc_rewrite()` only
+    u32 offset;                 // `smc_pipeline()` only, offset of the instruction to rewrite
+    u32 expected[SMC_MAX_SAMPLES];
+};
+
+static u32 iwram_buffer[SMC_BUFFER_SIZE / sizeof(u32)];
+EWRAM_BSS static u32 ewram_buffer[SMC_BUFFER_SIZE / sizeof(u32)];
+
+/*
+** Copy the routine of `smc` to the buffer of `kind` and return it.
+**
+** The copy itself rewrites code the previous test ran.
+*/
+static
+u32 *
+smc_place(
+    struct smc_test const *smc,
+    enum test_kind kind
+) {
+    u32 *buffer;
+
+    buffer = (kind == TEST_KIND_EWRAM) ? ewram_buffer : iwram_buffer;
+    memset(buffer, 0, SMC_BUFFER_SIZE);
+    memcpy(buffer, smc->code, smc->code_end - smc->code);
+    return buffer;
+}
+
+static
+smc_code_t
+smc_entry(
+    struct smc_test const *smc,
+    u32 *buffer
+) {
+    return (smc_code_t)((u32)buffer | smc->thumb);
+}
+
+static
+void
+smc_report(
+    struct test const *test,
+    u32 const *samples,
+    size_t nb_samples
+) {
+    struct smc_test const *smc;
+    size_t i;
+
+    smc = test->data;
+
+    report_begin(REPORT_SUITE_SELF_MODIFYING, test->idx, test->kind);
+    for (i = 0; i < nb_samples; ++i) {
+        report_sample(samples[i], smc->expected[i]);
+    }
+
+    log_puts(test->kind == TEST_KIND_EWRAM ? "EWRAM " : "IWRAM ");
+    log_dec(test->idx, 0);
+    log_puts(smc->thumb ? " THUMB" : "");
+
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR "\n");
+        return ;
+    }
+
+    for (i = 0; i < nb_samples; ++i) {
+        if (samples[i] != smc->expected[i]) {
+            log_puts(": FAIL (run ");
+            log_dec(i + 1, 0);
+            log_puts(") 0x");
+            log_hex(samples[i], 2);
+            log_puts(" != 0x");
+            log_hex(smc->expected[i], 2);
+            log_putc('\n');
+            break;
+        }
+    }
+}
+
+/*
+** Run the plain routine, rewrite its first instruction with `smc->method` and
+** run it again.
+*/
+static
+void
+smc_rewrite(
+    struct test const *test
+) {
+    struct smc_test const *smc;
+    u32 patched[SMC_BUFFER_SIZE / sizeof(u32)];
+    u32 samples[2];
+    u32 *buffer;
+    smc_code_t code;
+
+    smc = test->data;
+    buffer = smc_place(smc, test->kind);
+    code = smc_entry(smc, buffer);
+
+    samples[0] = code(NULL, 0);
+
+    memcpy(patched, buffer, SMC_BUFFER_SIZE);
+    if (smc->thumb) {
+        *(u16 *)patched = SMC_THUMB_PLAIN_PATCH;
+    } else {
+        patched[0] = SMC_ARM_PLAIN_PATCH;
+    }
+
+    switch (smc->method) {
+        case SMC_STORE8: {
+            *(vu8 *)buffer = *(u8 *)patched;
+            break;
+        }
+        case SMC_STORE16: {
+            *(vu16 *)buffer = *(u16 *)patched;
+            break;
+        }
+        case SMC_STORE32: {
+            *(vu32 *)buffer = patched[0];
+            break;
+        }
+        case SMC_DMA16:
+        case SMC_DMA32: {
+            REG_DMA3SAD = (u32)patched;
+            REG_DMA3DAD = (u32)buffer;
+            REG_DMA3CNT = DMA_ENABLE | (smc->method == SMC_DMA32 ? DMA32 : DMA16) | 1;
+
+            while (REG_DMA3CNT & DMA_ENABLE);
+            break;
+        }
+        case SMC_CPUSET: {
+            CpuSet(patched, buffer, COPY32 | 1);
+            break;
+        }
+        case SMC_CPUFASTSET: {
+            CpuFastSet(patched, buffer, SMC_BUFFER_SIZE / sizeof(u32));
+            break;
+        }
+    }
+
+    samples[1] = code(NULL, 0);
+
+    smc_report(test, samples, 2);
+}
+
+/*
+** Run the pipeline routine three times, the second run rewriting the
+** instruction at `smc->offset`. The other runs write to a scratch variable.
+*/
+static
+void
+smc_pipeline(
+    struct test const *test
+) {
+    struct smc_test const *smc;
+    u32 samples[3];
+    u32 *buffer;
+    u32 scratch;
+    u32 patch;
+    smc_code_t code;
+
+    smc = test->data;
+    buffer = smc_place(smc, test->kind);
+    code = smc_entry(smc, buffer);
+    patch = smc->thumb ? SMC_THUMB_PIPELINE_PATCH : SMC_ARM_PIPELINE_PATCH;
+
+    samples[0] = code(&scratch, patch);
+    samples[1] = code((u32 *)((u8 *)buffer + smc->offset), patch);
+    samples[2] = code(&scratch, patch);
+
+    smc_report(test, samples, 3);
+}
+
+#define NEW_REWRITE_TEST(_idx, _state, _thumb, _method)                     \
+    static struct smc_test const test_##_idx = {                            \
+        .code = smc_##_state##_plain,                                       \
+        .code_end = smc_##_state##_plain_end,                               \
+        .thumb = (_thumb),                                                  \
+        .method = (_method),                                                \
+        .expected = { 1, 2 },                                               \
+    };                                                                      \
+    REGISTER_TEST(self_modifying, _idx, TEST_KIND_IWRAM, smc_rewrite, &test_##_idx); \
+    REGISTER_TEST(self_modifying, _idx, TEST_KIND_EWRAM, smc_rewrite, &test_##_idx);
+
+#define NEW_PIPELINE_TEST(_idx, _state, _thumb, _offset, ...)               \
+    static struct smc_test const test_##_idx = {                            \
+        .code = smc_##_state##_pipeline,                                    \
+        .code_end = smc_##_state##_pipeline_end,                            \
+        .thumb = (_thumb),                                                  \
+        .offset = (_offset),                                                \
+        .expected = { __VA_ARGS__ },                                        \
+    };                                                                      \
+    REGISTER_TEST(self_modifying, _idx, TEST_KIND_IWRAM, smc_pipeline, &test_##_idx); \
+    REGISTER_TEST(self_modifying, _idx, TEST_KIND_EWRAM, smc_pipeline, &test_##_idx);
+
+NEW_REWRITE_TEST(1,  arm,   false, SMC_STORE8)
+NEW_REWRITE_TEST(2,  arm,   false, SMC_STORE16)
+NEW_REWRITE_TEST(3,  arm,   false, SMC_STORE32)
+NEW_REWRITE_TEST(4,  arm,   false, SMC_DMA16)
+NEW_REWRITE_TEST(5,  arm,   false, SMC_DMA32)
+NEW_REWRITE_TEST(6,  arm,   false, SMC_CPUSET)
+NEW_REWRITE_TEST(7,  arm,   false, SMC_CPUFASTSET)
+NEW_REWRITE_TEST(8,  thumb, true,  SMC_STORE8)
+NEW_REWRITE_TEST(9,  thumb, true,  SMC_STORE16)
+NEW_REWRITE_TEST(10, thumb, true,  SMC_STORE32)
+NEW_REWRITE_TEST(11, thumb, true,  SMC_DMA16)
+NEW_REWRITE_TEST(12, thumb, true,  SMC_DMA32)
+NEW_REWRITE_TEST(13, thumb, true,  SMC_CPUSET)
+NEW_REWRITE_TEST(14, thumb, true,  SMC_CPUFASTSET)
+
+NEW_PIPELINE_TEST(15, arm,   false, 0x8,   0x07, 0x07, 0x16)
+NEW_PIPELINE_TEST(16, arm,   false, 0xC,   0x07, 0x07, 0x15)
+NEW_PIPELINE_TEST(17, arm,   false, 0x10,  0x07, 0x13, 0x13)
+NEW_PIPELINE_TEST(18, thumb, true,  0x4,   0x07, 0x07, 0x16)
+NEW_PIPELINE_TEST(19, thumb, true,  0x6,   0x07, 0x07, 0x15)
+NEW_PIPELINE_TEST(20, thumb, true,  0x8,   0x07, 0x13, 0x13)
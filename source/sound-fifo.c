@@ -0,0 +1,462 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** When the sound FIFOs ask DMA1 and DMA2 for more samples, the case emulators
+** servicing the FIFOs in batches instead of on every sample get wrong.
+**
+** Each overflow of the timer of a FIFO consumes one of its bytes, then asks for
+** a refill if 16 bytes or less are left. A refill always writes 4 words. The
+** FIFOs start empty, so the first refill happens on the first overflow, the
+** second on the next one, 15 bytes being left, and the following ones every 16
+** overflows.
+**
+** Only Timer 0 and Timer 1 can drive the FIFOs. Timer 2 and Timer 3, cascaded,
+** timestamp each refill from the handler of its DMA's interrupt, woken up from
+** `IntrWait()` so the time it takes to run doesn't change.
+**
+** The frame tests start the FIFOs' timers right after a VBlank, count the
+** refills until the next one, their expected values being computed by
+** `fifo_refills()`, and time the third and fourth refills, 16 overflows apart.
+** The depth tests write a few words to FIFO A first, and count the overflows
+** before the first refill.
+**
+** Writing to a full FIFO, and feeding FIFO A with both DMAs, aren't measured
+** on hardware yet: build with `RECORD=1` to dump them. Until then they are
+** reported without golden.
+*/
+
+#include <gba_dma.h>
+#include <gba_interrupt.h>
+#include <gba_sound.h>
+#include <gba_systemcalls.h>
+#include <gba_timers.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(sound_fifo, REPORT_SUITE_SOUND_FIFO, "Sound Tests", "FIFO DMA Refills");
+
+#define FIFO_SAMPLES        4
+#define FIFO_TIMES          4       // Refills timestamped by the DMA handlers
+#define FIFO_FRAME          280896  // Cycles in a frame
+#define FIFO_DEPTH_PERIOD   1024    // Cycles between two overflows of the depth tests
+
+#define FIFO_A_TIMER1       (1 << 10)
+#define FIFO_B_TIMER1       (1 << 14)
+
+#define FIFO_TIMER(_reload, _flags)     ((_reload) | ((TIMER_START | (_flags)) << 16))
+
+// Written to REG_DMA1CNT and REG_DMA2CNT, the length being ignored
+#define FIFO_DMA_CNT        (                                               \
+      DMA_ENABLE | DMA_IRQ | DMA_REPEAT | DMA_SPECIAL                       \
+    | DMA_SRC_FIXED | DMA_DST_FIXED | DMA32 | 4                             \
+)
+
+struct fifo_test;
+
+typedef void (*fifo_run_t)(struct fifo_test const *ftest, u32 *measured, u32 *expected);
+
+struct fifo_test {
+    char const *name;
+    fifo_run_t run;
+    u32 tm0cnt;                 // Written to REG_TM0CNT, 0 to leave it stopped
+    u32 tm1cnt;                 // Written to REG_TM1CNT, 0 to leave it stopped
+    u16 soundcnt_h;             // Timers and outputs of the FIFOs
+    vu32 *dma2_fifo;            // FIFO DMA2 feeds, NULL to leave it off
+    u32 words[FIFO_SAMPLES];    // Words written to FIFO A before its timer starts
+    bool no_golden;
+};
+
+/*
+** Written by the DMA handlers.
+*/
+static u32 volatile fifo_refills_count[2];
+static u32 volatile fifo_refills_time[2][FIFO_TIMES];
+
+static u32 const fifo_silence = 0;
+
+/*
+** Read Timer 2 and Timer 3, cascaded, as a single counter.
+*/
+IWRAM_CODE
+static
+u32
+fifo_now(
+    void
+) {
+    u16 hi;
+    u16 lo;
+
+    hi = REG_TM3CNT_L;
+    lo = REG_TM2CNT_L;
+    if (REG_TM3CNT_L != hi) {
+        hi = REG_TM3CNT_L;
+        lo = REG_TM2CNT_L;
+    }
+    return ((u32)hi << 16) | lo;
+}
+
+IWRAM_CODE
+static
+void
+fifo_refill(
+    u32 dma
+) {
+    u32 count;
+
+    count = fifo_refills_count[dma];
+    if (count < FIFO_TIMES) {
+        fifo_refills_time[dma][count] = fifo_now();
+    }
+    fifo_refills_count[dma] = count + 1;
+}
+
+IWRAM_CODE
+static
+void
+fifo_dma1_handler(
+    void
+) {
+    fifo_refill(0);
+}
+
+IWRAM_CODE
+static
+void
+fifo_dma2_handler(
+    void
+) {
+    fifo_refill(1);
+}
+
+/*
+** Return the number of cycles between two overflows of the timer written
+** `cnt`, given those of the previous timer.
+*/
+static
+u32
+fifo_period(
+    u32 cnt,
+    u32 prev
+) {
+    static u8 const prescaler_shifts[4] = { 0, 6, 8, 10 };
+    u32 ticks;
+
+    ticks = 0x10000 - (cnt & 0xFFFF);
+    if ((cnt >> 16) & TIMER_COUNT) {
+        return ticks * prev;
+    }
+    return ticks << prescaler_shifts[(cnt >> 16) & 0x3];
+}
+
+/*
+** Return the number of refills a FIFO gets in a frame, if its timer overflows
+** every `period` cycles: one on the first overflow and one on the second, then
+** one every 16 overflows.
+*/
+static
+u32
+fifo_refills(
+    u32 period
+) {
+    u32 overflows;
+
+    overflows = FIFO_FRAME / period;
+    if (overflows < 2) {
+        return overflows;
+    }
+    return 2 + (overflows - 1) / 16;
+}
+
+/*
+** Reset the FIFOs, and arm DMA1 for FIFO A and DMA2 for `ftest->dma2_fifo`.
+*/
+IWRAM_CODE
+static
+void
+fifo_start(
+    struct fifo_test const *ftest
+) {
+    fifo_refills_count[0] = 0;
+    fifo_refills_count[1] = 0;
+
+    REG_SOUNDCNT_X |= SNDSTAT_ENABLE;
+    REG_SOUNDCNT_H = ftest->soundcnt_h | SNDA_RESET_FIFO | SNDB_RESET_FIFO;
+
+    REG_DMA1SAD = (u32)&fifo_silence;
+    REG_DMA1DAD = (u32)&REG_FIFO_A;
+    REG_DMA1CNT = FIFO_DMA_CNT;
+
+    if (ftest->dma2_fifo) {
+        REG_DMA2SAD = (u32)&fifo_silence;
+        REG_DMA2DAD = (u32)ftest->dma2_fifo;
+        REG_DMA2CNT = FIFO_DMA_CNT;
+    }
+
+    REG_TM3CNT = (TIMER_START | TIMER_COUNT) << 16;
+    REG_TM2CNT = TIMER_START << 16;
+}
+
+IWRAM_CODE
+static
+void
+fifo_stop(
+    void
+) {
+    REG_TM0CNT = 0;
+    REG_TM1CNT = 0;
+    REG_TM2CNT = 0;
+    REG_TM3CNT = 0;
+    REG_DMA1CNT = 0;
+    REG_DMA2CNT = 0;
+    REG_SOUNDCNT_H = 0;
+}
+
+/*
+** Count the refills of each FIFO during a frame, and time the fourth one from
+** the third, the first two being only one overflow apart.
+**
+** Timer 1 is started first, so it sees all of Timer 0's overflows when it
+** counts them.
+*/
+IWRAM_CODE
+static
+void
+fifo_run_frame(
+    struct fifo_test const *ftest,
+    u32 *measured,
+    u32 *expected
+) {
+    u32 periods[2];
+    u32 fifo;
+    u32 i;
+
+    fifo_start(ftest);
+
+    VBlankIntrWait();
+    REG_TM1CNT = ftest->tm1cnt;
+    REG_TM0CNT = ftest->tm0cnt;
+    VBlankIntrWait();
+
+    for (i = 0; i < 2; ++i) {
+        measured[2 * i] = fifo_refills_count[i];
+        measured[2 * i + 1] = fifo_refills_time[i][3] - fifo_refills_time[i][2];
+        if (fifo_refills_count[i] < 4) {
+            measured[2 * i + 1] = 0;
+        }
+    }
+
+    fifo_stop();
+
+    periods[0] = fifo_period(ftest->tm0cnt, 0);
+    periods[1] = fifo_period(ftest->tm1cnt, periods[0]);
+
+    for (i = 0; i < 2; ++i) {
+        expected[2 * i] = 0;
+        expected[2 * i + 1] = 0;
+
+        if (i == 1 && ftest->dma2_fifo != &REG_FIFO_B) {
+            continue;
+        }
+
+        fifo = i ? !!(ftest->soundcnt_h & FIFO_B_TIMER1) : !!(ftest->soundcnt_h & FIFO_A_TIMER1);
+        expected[2 * i] = fifo_refills(periods[fifo]);
+        expected[2 * i + 1] = 16 * periods[fifo];
+    }
+}
+
+/*
+** Write `ftest->words[i]` words to FIFO A, then count the overflows of Timer 0
+** before it asks for a refill.
+**
+** Each sample starts right after a VBlank, so its interrupt doesn't delay the
+** one of DMA1.
+*/
+IWRAM_CODE
+static
+void
+fifo_run_depth(
+    struct fifo_test const *ftest,
+    u32 *measured,
+    u32 *expected
+) {
+    u32 start;
+    u32 i;
+    u32 j;
+
+    for (i = 0; i < FIFO_SAMPLES; ++i) {
+        VBlankIntrWait();
+        fifo_start(ftest);
+        REG_DMA1CNT = 0;
+        for (j = 0; j < ftest->words[i]; ++j) {
+            REG_FIFO_A = fifo_silence;
+        }
+        REG_DMA1CNT = FIFO_DMA_CNT;
+
+        REG_TM0CNT = FIFO_TIMER(0x10000 - FIFO_DEPTH_PERIOD, 0);
+        start = fifo_now();
+        IntrWait(true, IRQ_DMA1);
+        measured[i] = (fifo_refills_time[0][0] - start) / FIFO_DEPTH_PERIOD;
+
+        fifo_stop();
+
+        // A byte is consumed before the FIFO is checked, even if it's empty
+        expected[i] = 4 * ftest->words[i] > 16 ? 4 * ftest->words[i] - 16 : 1;
+    }
+}
+
+static
+void
+fifo_run_test(
+    struct test const *test
+) {
+    struct fifo_test const *ftest;
+    u32 measured[FIFO_SAMPLES];
+    u32 expected[FIFO_SAMPLES];
+    u32 failed;
+    u16 ime;
+    u16 ie;
+    u32 i;
+
+    ftest = test->data;
+
+    ime = REG_IME;
+    ie = REG_IE;
+    REG_IME = 0;
+    REG_IE = IRQ_VBLANK | IRQ_DMA1 | IRQ_DMA2;
+    irqSet(IRQ_DMA1, fifo_dma1_handler);
+    irqSet(IRQ_DMA2, fifo_dma2_handler);
+    REG_IME = 1;
+
+    ftest->run(ftest, measured, expected);
+
+    REG_IME = 0;
+    irqSet(IRQ_DMA1, NULL);
+    irqSet(IRQ_DMA2, NULL);
+    REG_IF = IRQ_DMA1 | IRQ_DMA2;
+    REG_IE = ie;
+    REG_IME = ime;
+
+    report_begin(REPORT_SUITE_SOUND_FIFO, test->idx, TEST_KIND_IWRAM);
+    failed = FIFO_SAMPLES;
+    for (i = 0; i < FIFO_SAMPLES; ++i) {
+        if (ftest->no_golden) {
+            expected[i] = 0;
+        }
+        report_sample(measured[i], expected[i]);
+        if (measured[i] != expected[i] && failed == FIFO_SAMPLES) {
+            failed = i;
+        }
+    }
+
+    if (ftest->no_golden) {
+        report_unknown();
+    }
+
+    log_puts(ftest->name);
+
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR);
+        if (!RECORD && ftest->no_golden) {
+            log_puts(" (without golden)");
+        }
+        log_putc('\n');
+        return;
+    }
+
+    log_puts(": FAIL #");
+    log_dec(failed, 0);
+    log_puts(" 0x");
+    log_hex(measured[failed], 8);
+    log_puts(" != 0x");
+    log_hex(expected[failed], 8);
+    log_putc('\n');
+}
+
+#define NEW_TEST(_idx, ...)                                                 \
+    static struct fifo_test const test_##_idx = { __VA_ARGS__ };            \
+    REGISTER_TEST(sound_fifo, _idx, TEST_KIND_IWRAM, fifo_run_test, &test_##_idx);
+
+#define FIFO_A_ONLY         (SNDA_R_ENABLE | SNDA_L_ENABLE)
+#define FIFO_A_AND_B        (SNDA_R_ENABLE | SNDA_L_ENABLE | SNDB_R_ENABLE | SNDB_L_ENABLE)
+
+/*
+** FIFO A alone, on each timer and prescaler. The samples are its refills in a
+** frame and the cycles between its third and fourth refills, then the same for
+** FIFO B.
+*/
+NEW_TEST(1,  .name = "TIMER 0 P1",      .run = fifo_run_frame, .tm0cnt = FIFO_TIMER(0xFF00, 0), .soundcnt_h = FIFO_A_ONLY)
+NEW_TEST(2,  .name = "TIMER 0 P64",     .run = fifo_run_frame, .tm0cnt = FIFO_TIMER(0xFFF8, 1), .soundcnt_h = FIFO_A_ONLY)
+NEW_TEST(3,  .name = "TIMER 0 P256",    .run = fifo_run_frame, .tm0cnt = FIFO_TIMER(0xFFFE, 2), .soundcnt_h = FIFO_A_ONLY)
+NEW_TEST(4,  .name = "TIMER 0 P1024",   .run = fifo_run_frame, .tm0cnt = FIFO_TIMER(0xFFFF, 3), .soundcnt_h = FIFO_A_ONLY)
+NEW_TEST(5,  .name = "TIMER 1 P1",      .run = fifo_run_frame, .tm1cnt = FIFO_TIMER(0xFF00, 0), .soundcnt_h = FIFO_A_ONLY | FIFO_A_TIMER1)
+NEW_TEST(6,  .name = "TIMER 1 P64",     .run = fifo_run_frame, .tm1cnt = FIFO_TIMER(0xFFF8, 1), .soundcnt_h = FIFO_A_ONLY | FIFO_A_TIMER1)
+NEW_TEST(7,  .name = "TIMER 1 P256",    .run = fifo_run_frame, .tm1cnt = FIFO_TIMER(0xFFFE, 2), .soundcnt_h = FIFO_A_ONLY | FIFO_A_TIMER1)
+NEW_TEST(8,  .name = "TIMER 1 P1024",   .run = fifo_run_frame, .tm1cnt = FIFO_TIMER(0xFFFF, 3), .soundcnt_h = FIFO_A_ONLY | FIFO_A_TIMER1)
+
+NEW_TEST(9,
+    .name = "TIMER 1 CASCADE",
+    .run = fifo_run_frame,
+    .tm0cnt = FIFO_TIMER(0xFF80, 0),
+    .tm1cnt = FIFO_TIMER(0xFFFD, TIMER_COUNT),
+    .soundcnt_h = FIFO_A_ONLY | FIFO_A_TIMER1,
+)
+
+/*
+** Both FIFOs, DMA1 and DMA2 being requested on different overflows, then on
+** the same ones.
+*/
+NEW_TEST(10,
+    .name = "FIFO A+B",
+    .run = fifo_run_frame,
+    .tm0cnt = FIFO_TIMER(0xFF00, 0),
+    .tm1cnt = FIFO_TIMER(0xFE80, 0),
+    .soundcnt_h = FIFO_A_AND_B | FIFO_B_TIMER1,
+    .dma2_fifo = &REG_FIFO_B,
+)
+
+NEW_TEST(11,
+    .name = "FIFO A+B SAME TIMER",
+    .run = fifo_run_frame,
+    .tm0cnt = FIFO_TIMER(0xFF00, 0),
+    .soundcnt_h = FIFO_A_AND_B,
+    .dma2_fifo = &REG_FIFO_B,
+)
+
+/*
+** Overflows of Timer 0 before the first refill, with FIFO A holding 0 to 8
+** words, then more than it can hold.
+*/
+NEW_TEST(12,
+    .name = "FIFO DEPTH",
+    .run = fifo_run_depth,
+    .soundcnt_h = FIFO_A_ONLY,
+    .words = { 0, 4, 6, 8 },
+)
+
+NEW_TEST(13,
+    .name = "FIFO OVERRUN",
+    .run = fifo_run_depth,
+    .soundcnt_h = FIFO_A_ONLY,
+    .words = { 9, 10, 12, 16 },
+    .no_golden = true,
+)
+
+/*
+** DMA1 and DMA2 both feeding FIFO A.
+*/
+NEW_TEST(14,
+    .name = "FIFO A TWO DMAS",
+    .run = fifo_run_frame,
+    .tm0cnt = FIFO_TIMER(0xFF00, 0),
+    .soundcnt_h = FIFO_A_ONLY,
+    .dma2_fifo = &REG_FIFO_A,
+    .no_golden = true,
+)
@@ -7,14 +7,11 @@
 **
 \******************************************************************************/
 
-#include <gba_console.h>
-#include <gba_interrupt.h>
-#include <gba_systemcalls.h>
 #include <gba_timers.h>
-#include <stdio.h>
+#include "harness.h"
+#include "test.h"
 
-u16 nb_test_pass = 0;
-u16 nb_test_fail = 0;
+NEW_SUITE(timer_basic, REPORT_SUITE_TIMER_BASIC, "Timer Tests", "Basic tests");
 
 /*
 ** Ideas to explore:
@@ -24,70 +21,41 @@ u16 nb_test_fail = 0;
 **       is spent.
 */
 
-#define NEW_TEST(_idx, _samples_nb, _code) \
-    IWRAM_CODE \
-    static \
-    void \
-    test_0##_idx##_iwram(void) \
-    { \
-        u16 samples[_samples_nb]; \
-        u16 expected[_samples_nb]; \
-        bool iwram __unused; \
-        int i; \
-        \
-        iwram = true; \
-        \
-        _code; \
-        \
-        for (i = 0; i < _samples_nb; ++i) { \
-            if (samples[i] != expected[i]) { \
-                printf("IWRAM %i: FAIL 0x%04X != 0x%04X", (_idx), samples[i], expected[i]); \
-                nb_test_fail += 1; \
-                return ; \
-            } \
-        } \
-        printf("IWRAM %i: PASS\n", (_idx)); \
-        nb_test_pass += 1; \
-    } \
-    \
-    static \
-    void \
-    test_0##_idx##_rom(void) \
-    { \
-        u16 samples[_samples_nb]; \
-        u16 expected[_samples_nb]; \
-        bool iwram __unused; \
-        int i; \
-        \
-        iwram = false; \
-        \
-        _code; \
-        \
-        for (i = 0; i < _samples_nb; ++i) { \
-            if (samples[i] != expected[i]) { \
-                printf("ROM   %i: FAIL 0x%04X != 0x%04X", (_idx), samples[i], expected[i]); \
-                nb_test_fail += 1; \
-                return ; \
-            } \
-        } \
-        printf("ROM   %i: PASS\n", (_idx)); \
-        nb_test_pass += 1; \
-    } \
+/*
+** Each test body is built twice from the same assembly, once in ARM state and
+** once in THUMB state, each with its own expected values.
+*/
+#define NEW_TEST(_idx, _expected, _thumb_expected, _code) \
+    NEW_HARNESS_TEST(test_0##_idx, _expected, _code); \
+    NEW_HARNESS_TEST_THUMB(test_0##_idx##_thumb, _thumb_expected, _code); \
+    REGISTER_HARNESS_TEST_ALL_KINDS(timer_basic, (_idx), test_0##_idx); \
+    REGISTER_HARNESS_TEST_ALL_KINDS(timer_basic, (_idx), test_0##_idx##_thumb);
 
 /*
-** Start a timer and ensure it evolves consistently.
+** Only the ARM values from IWRAM and from the power-on ROM setting (WS0,
+** without prefetch) were measured on hardware. The THUMB values from IWRAM are
+** the same: every access to IWRAM and to the timers takes a single cycle
+** whatever its width, and each instruction of the bodies assembles to a THUMB
+** one doing the same accesses. Checking the other settings, and the other
+** THUMB ones, is deferred until they are recorded (see `RECORD`):
+** until then they only record what they measure, and are reported without
+** golden. `tools/timing.py` predicts them, but it was fitted to these same
+** values, so its tables aren't used in their place.
+**
+**     ./tools/timing.py --suite source/timer-basic.c
 */
-NEW_TEST(1, 3,  {
-    if (iwram) {
-        expected[0] = 0x0000;
-        expected[1] = 0x0003;
-        expected[2] = 0x0006;
-    } else {
-        expected[0] = 0x0007;
-        expected[1] = 0x0011;
-        expected[2] = 0x001B;
-    }
 
+/*
+** Start a timer and ensure it evolves consistently.
+*/
+static u16 const TEST_01_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][3] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0000, 0x0003, 0x0006 },
+    [TEST_KIND_ROM_WITHOUT_PREFETCH][HARNESS_WS(0, 0)]     = { 0x0007, 0x0011, 0x001B },
+};
+static u16 const TEST_01_THUMB_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][3] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0000, 0x0003, 0x0006 },
+};
+NEW_TEST(1, TEST_01_RESULTS, TEST_01_THUMB_RESULTS, {
     __asm__ volatile(
         // Set r1 to REG_TM0CNT
         "ldr r1, =#0x04000100\n"
@@ -130,17 +98,14 @@ NEW_TEST(1, 3,  {
 /*
 ** Ensure the timer doesn't evolve anymore after being stopped.
 */
-NEW_TEST(2, 3,  {
-    if (iwram) {
-        expected[0] = 0x0003;
-        expected[1] = 0x0008;
-        expected[2] = 0x0008;
-    } else {
-        expected[0] = 0x0019;
-        expected[1] = 0x002A;
-        expected[2] = 0x002A;
-    }
-
+static u16 const TEST_02_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][3] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0003, 0x0008, 0x0008 },
+    [TEST_KIND_ROM_WITHOUT_PREFETCH][HARNESS_WS(0, 0)]     = { 0x0019, 0x002A, 0x002A },
+};
+static u16 const TEST_02_THUMB_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][3] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0003, 0x0008, 0x0008 },
+};
+NEW_TEST(2, TEST_02_RESULTS, TEST_02_THUMB_RESULTS, {
     __asm__ volatile(
         // Set r1 to REG_TM0CNT
         "ldr r1, =#0x04000100\n"
@@ -205,13 +170,14 @@ NEW_TEST(2, 3,  {
 /*
 ** Start and immediately stop the timer.
 */
-NEW_TEST(3, 1,  {
-    if (iwram) {
-        expected[0] = 0x0001;
-    } else {
-        expected[0] = 0x0008;
-    }
-
+static u16 const TEST_03_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0001 },
+    [TEST_KIND_ROM_WITHOUT_PREFETCH][HARNESS_WS(0, 0)]     = { 0x0008 },
+};
+static u16 const TEST_03_THUMB_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0001 },
+};
+NEW_TEST(3, TEST_03_RESULTS, TEST_03_THUMB_RESULTS, {
     __asm__ volatile(
         // Set r1 to REG_TM0CNT
         "ldr r1, =#0x04000100\n"
@@ -246,13 +212,14 @@ NEW_TEST(3, 1,  {
 /*
 ** Measure the time it takes to read REG_TM0CNT.
 */
-NEW_TEST(4, 1,  {
-    if (iwram) {
-        expected[0] = 0x0005;
-    } else {
-        expected[0] = 0x0018;
-    }
-
+static u16 const TEST_04_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0005 },
+    [TEST_KIND_ROM_WITHOUT_PREFETCH][HARNESS_WS(0, 0)]     = { 0x0018 },
+};
+static u16 const TEST_04_THUMB_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0005 },
+};
+NEW_TEST(4, TEST_04_RESULTS, TEST_04_THUMB_RESULTS, {
     __asm__ volatile(
         // Set r1 to REG_TM0CNT
         "ldr r1, =#0x04000100\n"
@@ -291,13 +258,14 @@ NEW_TEST(4, 1,  {
 /*
 ** Start, Reset and Stop the timer.
 */
-NEW_TEST(5, 1,  {
-    if (iwram) {
-        expected[0] = 0x0009;
-    } else {
-        expected[0] = 0x0035;
-    }
-
+static u16 const TEST_05_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0009 },
+    [TEST_KIND_ROM_WITHOUT_PREFETCH][HARNESS_WS(0, 0)]     = { 0x0035 },
+};
+static u16 const TEST_05_THUMB_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][1] = {
+    [TEST_KIND_IWRAM][HARNESS_WS(0, 0)]                    = { 0x0009 },
+};
+NEW_TEST(5, TEST_05_RESULTS, TEST_05_THUMB_RESULTS, {
     __asm__ volatile(
         // Set r1 to REG_TM0CNT
         "ldr r1, =#0x04000100\n"
@@ -341,38 +309,3 @@ NEW_TEST(5, 1,  {
             "r0", "r1", "r2"
     );
 });
-
-IWRAM_CODE
-int
-main(void)
-{
-    irqInit();
-    consoleDemoInit();
-
-    printf("Timer Tests\n");
-    printf("  Basic tests\n\n\n");
-
-    irqEnable(IRQ_VBLANK);
-    VBlankIntrWait();
-
-    test_01_rom();
-    test_02_rom();
-    test_03_rom();
-    test_04_rom();
-    test_05_rom();
-
-    test_01_iwram();
-    test_02_iwram();
-    test_03_iwram();
-    test_04_iwram();
-    test_05_iwram();
-
-    printf("\n");
-    printf("Total: %u/%u\n", nb_test_pass, nb_test_pass + nb_test_fail);
-
-    while (true) {
-        VBlankIntrWait();
-    }
-
-    return (0);
-}
@@ -0,0 +1,477 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2024 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Timers read at arbitrary points, the case that breaks emulators computing
+** timers from timestamps instead of ticking them every cycle.
+**
+** Each test starts the four timers, waits a pseudo-random number of cycles,
+** rewrites Timer 0's reload value, waits again, and reads the four counters
+** and REG_IF. It does so for `TIMER_CASES` pairs of delays, drawn from a
+** fixed seed so each run goes through the same ones.
+**
+** The expected values are computed by `cascade_model()`, a closed-form model
+** of the timers following the same rules as `tools/timing.py`:
+**   - A timer enabled by a write ending at cycle T reads
+**     `reload + (t - T - 1) / prescaler` at cycle t. `timer-basic` measured
+**     it on hardware, but only with a prescaler of 1.
+**   - A count-up timer ticks in the cycle the previous timer overflows.
+**   - An overflow visible by the cycle a new reload value is written still
+**     reloads the previous one.
+**   - The overflow sets the timer's flag in REG_IF in the same cycle.
+** The last three are assumptions that weren't measured.
+**
+** Only the tests whose timers all count cycles or overflows without prescaler
+** are checked against the model. With a prescaler, the first rule starts the
+** prescaler when the timer starts, but the hardware might as well divide a
+** clock that never stops, as mGBA does, and the timer's first tick would then
+** come anywhere within the prescaler's period. Those tests report the values
+** read in their last case against `recorded`, and without golden until a
+** `RECORD=1` run on hardware fills it in.
+*/
+
+#include <stddef.h>
+#include <gba_interrupt.h>
+#include <gba_timers.h>
+#include "log.h"
+#include "report.h"
+#include "test.h"
+
+NEW_SUITE(timer_cascade, REPORT_SUITE_TIMER_CASCADE, "Timer Tests", "Cascades & Lazy Evaluation");
+
+#define TIMER_CASES         16
+#define TIMER_TESTS         12
+#define TIMER_SAMPLES       5   // The four counters and REG_IF
+#define TIMER_IF_MASK       (IRQ_TIMER0 | IRQ_TIMER1 | IRQ_TIMER2 | IRQ_TIMER3)
+
+static u32 const prescalers[4] = { 1, 64, 256, 1024 };
+
+/*
+** The arguments of `timer_cascade_run()`, and the values it read.
+*/
+struct cascade_run {
+    u32 cnt[4];         // Written to REG_TMxCNT, Timer 3 first
+    u32 delay1;         // Iterations of the first delay loop, at least 1
+    u32 reload;         // Written to REG_TM0CNT_L after the first delay
+    u32 delay2;         // Iterations of the second delay loop, at least 1
+    u16 values[5];      // REG_TM0CNT_L to REG_TM3CNT_L, and REG_IF
+};
+
+static_assert(offsetof(struct cascade_run, values) == 0x1C);
+
+/*
+** Run from IWRAM, where every access takes a single cycle.
+**
+** Relative to the end of the write starting Timer 0, with `n1` and `n2` the
+** number of iterations of the delay loops:
+**   - Timers 3, 2 and 1 are started 6, 4 and 2 cycles earlier.
+**   - The new reload value is written at the end of cycle `4 * n1`.
+**   - Timer `i` is read at cycle `4 * (n1 + n2) - 1 + 3 * i`, and REG_IF 3
+**     cycles after Timer 3.
+*/
+__asm__(
+    ".pushsection .iwram, \"ax\", %progbits\n"
+    ".balign 4\n"
+    ".arm\n"
+    "timer_cascade_run:\n"
+    "push {r4-r9, lr}\n"
+
+    // Set r12 to REG_TM0CNT and r8 to REG_IF
+    "ldr r12, =#0x04000100\n"
+    "ldr r8, =#0x04000202\n"
+
+    // Acknowledge the timers' interrupts
+    "mov r9, #0x78\n"
+    "strh r9, [r8]\n"
+
+    // Start the timers, Timer 0 last
+    "ldm r0, {r1-r7}\n"
+    "str r4, [r12, #0xC]\n"
+    "str r3, [r12, #0x8]\n"
+    "str r2, [r12, #0x4]\n"
+    "str r1, [r12]\n"
+
+    "1:\n"
+    "subs r5, r5, #1\n"     // 1S
+    "bne 1b\n"              // 2S + 1N if taken, 1S otherwise
+
+    // Rewrite Timer 0's reload value
+    "strh r6, [r12]\n"
+
+    "2:\n"
+    "subs r7, r7, #1\n"
+    "bne 2b\n"
+
+    // Read the counters and REG_IF
+    "ldrh r1, [r12]\n"
+    "ldrh r2, [r12, #0x4]\n"
+    "ldrh r3, [r12, #0x8]\n"
+    "ldrh r4, [r12, #0xC]\n"
+    "ldrh r5, [r8]\n"
+
+    // Stop the timers and acknowledge their interrupts
+    "mov r6, #0\n"
+    "str r6, [r12]\n"
+    "str r6, [r12, #0x4]\n"
+    "str r6, [r12, #0x8]\n"
+    "str r6, [r12, #0xC]\n"
+    "strh r9, [r8]\n"
+
+    "strh r1, [r0, #0x1C]\n"
+    "strh r2, [r0, #0x1E]\n"
+    "strh r3, [r0, #0x20]\n"
+    "strh r4, [r0, #0x22]\n"
+    "strh r5, [r0, #0x24]\n"
+
+    "pop {r4-r9, lr}\n"
+    "bx lr\n"
+    ".ltorg\n"
+    ".popsection\n"
+);
+
+__attribute__((long_call))
+void timer_cascade_run(struct cascade_run *run);
+
+/*
+** Values read by the last case of the tests using a prescaler, on hardware.
+*/
+static u16 const recorded[TIMER_TESTS][TIMER_SAMPLES] = {
+    { 0 },
+};
+
+struct cascade_test {
+    char const *name;
+    u16 reload[4];
+    u16 control[4];
+    u16 new_reload;     // Written to REG_TM0CNT_L between the two delays
+    u32 max_delay;      // Maximum number of iterations of each delay loop
+};
+
+/*
+** Return how many times Timer `idx` overflowed by cycle `t`, and store its
+** counter in `counter`.
+**
+** `t` and `w`, the cycle at which the new reload value is written, are
+** relative to the end of the write starting Timer 0.
+*/
+static
+u32
+cascade_model(
+    struct cascade_test const *test,
+    u32 idx,
+    s32 t,
+    s32 w,
+    u32 *counter
+) {
+    s32 start;
+    u32 prescaler;
+    u32 ticks;
+    u32 split;
+    u32 reload;
+    u32 overflows;
+    u32 value;
+
+    if (idx && (test->control[idx] & TIMER_COUNT)) {
+        ticks = cascade_model(test, idx - 1, t, w, &value);
+        split = ticks;
+    } else {
+        start = -2 * (s32)idx;
+        prescaler = prescalers[test->control[idx] & 3];
+        ticks = (t - start > 1) ? (t - start - 1) / prescaler : 0;
+
+        // Only Timer 0's reload value changes.
+        split = ticks;
+        if (!idx) {
+            split = (w > 1) ? (w - 1) / prescaler : 0;
+            split = split < ticks ? split : ticks;
+        }
+    }
+
+    reload = test->reload[idx];
+    overflows = split / (0x10000 - reload);
+    value = reload + split % (0x10000 - reload);
+    ticks -= split;
+
+    if (ticks >= 0x10000 - value) {
+        ticks -= 0x10000 - value;
+        reload = test->new_reload;
+        overflows += 1 + ticks / (0x10000 - reload);
+        value = reload + ticks % (0x10000 - reload);
+    } else {
+        value += ticks;
+    }
+
+    *counter = value;
+    return overflows;
+}
+
+/*
+** Return whether a timer of `test` not counting overflows uses a prescaler.
+*/
+static
+bool
+cascade_prescaled(
+    struct cascade_test const *test
+) {
+    u32 i;
+
+    for (i = 0; i < 4; ++i) {
+        if ((!i || !(test->control[i] & TIMER_COUNT)) && (test->control[i] & 3)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+** Return the next pseudo-random number of iterations of a delay loop, between
+** 1 and `max`.
+*/
+static
+u32
+cascade_delay(
+    u32 *seed,
+    u32 max
+) {
+    *seed = *seed * 1103515245 + 12345;
+    return 1 + (*seed >> 8) % max;
+}
+
+static
+void
+cascade_run_test(
+    struct test const *test
+) {
+    struct cascade_test const *ctest;
+    struct cascade_run run;
+    u16 const *golden;
+    u32 expected[TIMER_SAMPLES];
+    u32 failed_expected[TIMER_SAMPLES];
+    u16 failed_values[TIMER_SAMPLES];
+    u32 failed_case;
+    u32 seed;
+    u32 value;
+    u32 i;
+    u32 j;
+    s32 t;
+    s32 w;
+    u16 ime;
+    bool prescaled;
+    bool known;
+
+    ctest = test->data;
+    golden = recorded[test->idx - 1];
+    prescaled = cascade_prescaled(ctest);
+    seed = test->idx;
+    failed_case = 0;
+
+    ime = REG_IME;
+    REG_IME = 0;
+
+    for (i = 0; i < TIMER_CASES; ++i) {
+        for (j = 0; j < 4; ++j) {
+            run.cnt[j] = ctest->reload[j] | (ctest->control[j] << 16);
+        }
+        run.delay1 = cascade_delay(&seed, ctest->max_delay);
+        run.reload = ctest->new_reload;
+        run.delay2 = cascade_delay(&seed, ctest->max_delay);
+
+        timer_cascade_run(&run);
+        run.values[4] &= TIMER_IF_MASK;
+
+        // Without a model, only the last case is kept, and checked against its record
+        if (prescaled) {
+            for (j = 0; j < TIMER_SAMPLES; ++j) {
+                failed_values[j] = run.values[j];
+                failed_expected[j] = golden[j];
+            }
+            failed_case = i + 1;
+            continue;
+        }
+
+        w = 4 * run.delay1;
+        t = 4 * (run.delay1 + run.delay2) - 1;
+        expected[4] = 0;
+        for (j = 0; j < 4; ++j) {
+            cascade_model(ctest, j, t + 3 * j, w, &expected[j]);
+            if (cascade_model(ctest, j, t + 12, w, &value)) {
+                expected[4] |= IRQ_TIMER0 << j;
+            }
+        }
+
+        // Keep the first failing case, or the last one if none failed.
+        if (!failed_case) {
+            for (j = 0; j < TIMER_SAMPLES; ++j) {
+                failed_values[j] = run.values[j];
+                failed_expected[j] = expected[j];
+                if (run.values[j] != expected[j]) {
+                    failed_case = i + 1;
+                }
+            }
+        }
+    }
+
+    REG_IME = ime;
+
+    report_begin(REPORT_SUITE_TIMER_CASCADE, test->idx, TEST_KIND_IWRAM);
+    known = !prescaled;
+    for (j = 0; j < TIMER_SAMPLES; ++j) {
+        report_sample(failed_values[j], failed_expected[j]);
+        known |= !!golden[j];
+    }
+
+    if (!known) {
+        report_unknown();
+    }
+
+    log_puts(ctest->name);
+    if (report_end()) {
+        log_puts(": " REPORT_PASS_STR);
+        if (!RECORD && !known) {
+            log_puts(" (without golden)");
+        }
+        log_putc('\n');
+        return ;
+    }
+
+    log_puts(": FAIL (case ");
+    log_dec(failed_case, 0);
+    log_puts(")\n");
+    for (j = 0; j < TIMER_SAMPLES; ++j) {
+        if (failed_values[j] != failed_expected[j]) {
+            log_puts(j < 4 ? "    TM" : "    IF");
+            if (j < 4) {
+                log_dec(j, 0);
+            }
+            log_puts(" 0x");
+            log_hex(failed_values[j], 4);
+            log_puts(" != 0x");
+            log_hex(failed_expected[j], 4);
+            log_putc('\n');
+        }
+    }
+}
+
+#define CASCADE(_prescaler) {                                               \
+        TIMER_START | TIMER_IRQ | (_prescaler),                             \
+        TIMER_START | TIMER_IRQ | TIMER_COUNT,                              \
+        TIMER_START | TIMER_IRQ | TIMER_COUNT,                              \
+        TIMER_START | TIMER_IRQ | TIMER_COUNT,                              \
+    }
+
+#define FREE(_p0, _p1, _p2, _p3) {                                          \
+        TIMER_START | TIMER_IRQ | (_p0),                                    \
+        TIMER_START | TIMER_IRQ | (_p1),                                    \
+        TIMER_START | TIMER_IRQ | (_p2),                                    \
+        TIMER_START | TIMER_IRQ | (_p3),                                    \
+    }
+
+#define NEW_TEST(_idx, ...)                                                 \
+    static struct cascade_test const test_##_idx = { __VA_ARGS__ };        \
+    static_assert((_idx) <= TIMER_TESTS);                                   \
+    REGISTER_TEST(timer_cascade, _idx, TEST_KIND_IWRAM, cascade_run_test, &test_##_idx);
+
+/*
+** Timer 0 drives the three others, which overflow every 4, 8 and 32 of its
+** overflows.
+*/
+NEW_TEST(1,
+    .name = "CASCADE P1",
+    .reload = { 0xFFF0, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(0),
+    .new_reload = 0xFFF0,
+    .max_delay = 128,
+)
+NEW_TEST(2,
+    .name = "CASCADE P64",
+    .reload = { 0xFFF0, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(1),
+    .new_reload = 0xFFF0,
+    .max_delay = 128 * 64,
+)
+NEW_TEST(3,
+    .name = "CASCADE P256",
+    .reload = { 0xFFF0, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(2),
+    .new_reload = 0xFFF0,
+    .max_delay = 128 * 256,
+)
+NEW_TEST(4,
+    .name = "CASCADE P1024",
+    .reload = { 0xFFF0, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(3),
+    .new_reload = 0xFFF0,
+    .max_delay = 128 * 1024,
+)
+
+/*
+** Same, but Timer 0's reload value changes from 0xFF00 to 0xFFE0 while it
+** runs, sometimes before its first overflow, sometimes after.
+*/
+NEW_TEST(5,
+    .name = "RELOAD P1",
+    .reload = { 0xFF00, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(0),
+    .new_reload = 0xFFE0,
+    .max_delay = 128,
+)
+NEW_TEST(6,
+    .name = "RELOAD P64",
+    .reload = { 0xFF00, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(1),
+    .new_reload = 0xFFE0,
+    .max_delay = 128 * 64,
+)
+NEW_TEST(7,
+    .name = "RELOAD P256",
+    .reload = { 0xFF00, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(2),
+    .new_reload = 0xFFE0,
+    .max_delay = 128 * 256,
+)
+NEW_TEST(8,
+    .name = "RELOAD P1024",
+    .reload = { 0xFF00, 0xFFFC, 0xFFFE, 0xFFFC },
+    .control = CASCADE(3),
+    .new_reload = 0xFFE0,
+    .max_delay = 128 * 1024,
+)
+
+/*
+** The four timers run on their own, each with a different prescaler, and all
+** overflow every 4096 cycles.
+*/
+NEW_TEST(9,
+    .name = "FREE P1/64/256/1024",
+    .reload = { 0xF000, 0xFFC0, 0xFFF0, 0xFFFC },
+    .control = FREE(0, 1, 2, 3),
+    .new_reload = 0xF000,
+    .max_delay = 2048,
+)
+NEW_TEST(10,
+    .name = "FREE P64/256/1024/1",
+    .reload = { 0xFFC0, 0xFFF0, 0xFFFC, 0xF000 },
+    .control = FREE(1, 2, 3, 0),
+    .new_reload = 0xFFC0,
+    .max_delay = 2048,
+)
+NEW_TEST(11,
+    .name = "FREE P256/1024/1/64",
+    .reload = { 0xFFF0, 0xFFFC, 0xF000, 0xFFC0 },
+    .control = FREE(2, 3, 0, 1),
+    .new_reload = 0xFFF0,
+    .max_delay = 2048,
+)
+NEW_TEST(12,
+    .name = "FREE P1024/1/64/256",
+    .reload = { 0xFFFC, 0xF000, 0xFFC0, 0xFFF0 },
+    .control = FREE(3, 0, 1, 2),
+    .new_reload = 0xFFFC,
+    .max_delay = 2048,
+)
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+
+################################################################################
+##
+##  This file is part of the Hades GBA Emulator, and is made available under
+##  the terms of the GNU General Public License version 2.
+##
+##  Copyright (C) 2021-2024 - The Hades Authors
+##
+################################################################################
+
+"""Turn the record of a `RECORD=1` run into expected-value tables.
+
+Run the ROMs built with `RECORD=1` on real hardware, then feed the resulting
+save file (or a memory dump of EWRAM) to this script:
+
+    ./tools/goldens.py hades-tests.sav
+    ./tools/goldens.py --suite TIMER_BASIC hades-tests.sav
+
+It prints, for each test, a table in the format used by the suites. Those run
+through the harness index it by kind and waitstate setting:
+
+    static u16 const TEST_01_RESULTS[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX][3] = {
+        [TEST_KIND_IWRAM][HARNESS_WS(0, 0)] = { 0x0000, 0x0003, 0x0006 },
+        ...
+    };
+
+Others index it by kind, or get a row per variant when their variants aren't
+kinds, such as the case indices of `hades_report.INDEXED_SUITES`.
+"""
+
+import argparse
+import sys
+from collections import defaultdict
+
+import hades_report
+
+
+def print_tables(entries, kinds, out, harness, indexed=False):
+    """Print the expected-value tables of the entries of a suite.
+
+    Harness suites get a table per kind and waitstate setting, for ARM and
+    THUMB bodies. Other suites get one per kind if their variants are kinds,
+    and otherwise a row per raw variant, in order, for the suite to index as
+    it encodes them, as do indexed suites.
+    """
+
+    tests = defaultdict(dict)
+    for entry in entries:
+        tests[(entry.test, harness and entry.thumb)][entry.variant] = entry.measured
+
+    for (test, thumb), variants in sorted(tests.items()):
+        nb_samples = max(len(samples) for samples in variants.values())
+        wide = any(sample > 0xFFFF for samples in variants.values() for sample in samples)
+        ctype, digits = ('u32', 8) if wide else ('u16', 4)
+        table = f'TEST_{test:02}_THUMB_RESULTS' if thumb else f'TEST_{test:02}_RESULTS'
+        raw = indexed or (not harness and any(variant not in kinds for variant in variants))
+
+        if harness:
+            dims = '[TEST_KIND_MAX][HARNESS_WAITSTATES_MAX]'
+        elif raw:
+            dims = f'[{len(variants)}]'
+        else:
+            dims = '[TEST_KIND_MAX]'
+
+        rows = []
+        for variant, samples in sorted(variants.items(), key=lambda x: (x[0] & 0x7F, x[0] >> 8) if harness else x[0]):
+            if raw:
+                name = f'/* 0x{variant:04X} */'
+            else:
+                name = f'[{kinds.get(variant & 0x7F, str(variant & 0x7F))}]'
+            if harness:
+                name += f'[{hades_report.harness_ws(variant >> 8)}]'
+            values = ', '.join(f'0x{sample:0{digits}X}' for sample in samples)
+            rows.append((name, values))
+
+        width = max(35, max(len(name) for name, _ in rows))
+        print(f'static {ctype} const {table}{dims}[{nb_samples}] = {{', file=out)
+        for name, values in rows:
+            if raw:
+                print(f'    {name:<{width}}   {{ {values} }},', file=out)
+            else:
+                print(f'    {name:<{width}} = {{ {values} }},', file=out)
+        print('};', file=out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('record', help='save file or memory dump holding the record')
+    parser.add_argument('--offset', type=lambda x: int(x, 0), help='offset of the record (default: search for it)')
+    parser.add_argument('--suite', action='append', help='only print the tables of this suite (eg. TIMER_BASIC)')
+    args = parser.parse_args()
+
+    try:
+        report = hades_report.load(args.record, args.offset)
+    except (OSError, hades_report.ReportError) as e:
+        print(f'{args.record}: {e}', file=sys.stderr)
+        return 1
+
+    if not report.done:
+        print(f'{args.record}: warning: the run didn\'t complete', file=sys.stderr)
+
+    if any(entry.status != hades_report.REPORT_STATUS_RECORDED for entry in report.entries):
+        print(f'{args.record}: warning: not a record build, dumping the measured samples anyway', file=sys.stderr)
+
+    if report.nb_tests > len(report.entries):
+        print(f'{args.record}: warning: {report.nb_tests - len(report.entries)} tests didn\'t fit in the record', file=sys.stderr)
+
+    suites = hades_report.suite_names()
+    kinds = hades_report.kind_names()
+    selected = {f'REPORT_SUITE_{name.upper()}' for name in args.suite} if args.suite else None
+
+    by_suite = defaultdict(list)
+    for entry in report.entries:
+        by_suite[entry.suite].append(entry)
+
+    first = True
+    for suite, entries in sorted(by_suite.items()):
+        name = suites.get(suite, f'suite {suite}')
+        if selected is not None and name not in selected:
+            continue
+
+        if not first:
+            print()
+        first = False
+
+        print(f'/* {name} */')
+        print_tables(entries, kinds, sys.stdout, name in hades_report.HARNESS_SUITES, name in hades_report.INDEXED_SUITES)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,246 @@
+################################################################################
+##
+##  This file is part of the Hades GBA Emulator, and is made available under
+##  the terms of the GNU General Public License version 2.
+##
+##  Copyright (C) 2021-2024 - The Hades Authors
+##
+################################################################################
+
+"""Parse the result record written by the test ROMs.
+
+The layout is described in `include/report.h` and in the README. The record
+sits at the beginning of the cartridge's SRAM (the `.sav` file), and at
+`0x02038000` in EWRAM.
+"""
+
+import os
+import re
+import struct
+from dataclasses import dataclass, field
+
+REPORT_MAGIC = 0x52534448  # "HDSR"
+REPORT_VERSION = 3
+REPORT_STATE_RUNNING = 0x4E4E5552  # "RUNN"
+REPORT_STATE_DONE = 0x454E4F44  # "DONE"
+
+REPORT_STATUS_FAIL = 0
+REPORT_STATUS_PASS = 1
+REPORT_STATUS_RECORDED = 2
+REPORT_STATUS_NO_GOLDEN = 3
+
+REPORT_ENTRY_16BIT = 0x01
+
+HARNESS_VARIANT_THUMB = 0x80
+
+# Suites run through the harness, whose variants are a kind, the THUMB bit and
+# a waitstate setting. Other suites use their variant as they see fit.
+HARNESS_SUITES = {
+    'REPORT_SUITE_DMA_START_DELAY',
+    'REPORT_SUITE_TIMER_BASIC',
+    'REPORT_SUITE_IDLE_LOOPS',
+}
+
+# Suites whose variant is the index of a case of the test, rather than a kind.
+INDEXED_SUITES = {
+    'REPORT_SUITE_DMA_TIMING',
+    'REPORT_SUITE_SCHEDULER_LOAD',
+}
+
+HEADER = struct.Struct('<IHHHHHHI')
+ENTRY_PREFIX = struct.Struct('<BBHHBB')
+
+ROOT = os.path.realpath(os.path.join(os.path.dirname(__file__), '..'))
+
+
+class ReportError(Exception):
+    pass
+
+
+@dataclass
+class Entry:
+    suite: int
+    status: int
+    test: int
+    variant: int
+    measured: list = field(default_factory=list)
+    expected: list = field(default_factory=list)
+
+    @property
+    def passed(self):
+        return self.status in (REPORT_STATUS_PASS, REPORT_STATUS_RECORDED)
+
+    @property
+    def kind(self):
+        """Kind of the test, for harness tests."""
+        return self.variant & 0x7F
+
+    @property
+    def thumb(self):
+        """Whether the body of the harness test is THUMB."""
+        return bool(self.variant & HARNESS_VARIANT_THUMB)
+
+    @property
+    def waitstates(self):
+        """Waitstate setting (`HARNESS_WS()`), for harness tests."""
+        return self.variant >> 8
+
+
+@dataclass
+class Report:
+    version: int
+    nb_tests: int
+    nb_pass: int
+    nb_fail: int
+    state: int
+    entries: list = field(default_factory=list)
+
+    @property
+    def done(self):
+        return self.state == REPORT_STATE_DONE
+
+
+def find(data):
+    """Return the offset of the record in `data`, or None if there's none."""
+
+    magic = struct.pack('<I', REPORT_MAGIC)
+    offset = data.find(magic)
+    while offset != -1 and offset % 4:
+        offset = data.find(magic, offset + 1)
+    return None if offset == -1 else offset
+
+
+def parse(data, offset=None):
+    """Parse the record found in `data` (a save file or a memory dump)."""
+
+    if offset is None:
+        offset = find(data)
+        if offset is None:
+            raise ReportError('no result record found')
+
+    if len(data) < offset + HEADER.size:
+        raise ReportError('truncated result record')
+
+    (magic, version, entries_size, nb_tests, nb_entries, nb_pass, nb_fail, state) = HEADER.unpack_from(data, offset)
+
+    if magic != REPORT_MAGIC:
+        raise ReportError(f'bad magic 0x{magic:08X}')
+
+    if version != REPORT_VERSION:
+        raise ReportError(f'unsupported version {version}')
+
+    report = Report(version, nb_tests, nb_pass, nb_fail, state)
+
+    offset += HEADER.size
+    end = offset + entries_size
+    if len(data) < end:
+        raise ReportError('truncated result record')
+
+    for _ in range(nb_entries):
+        if end < offset + ENTRY_PREFIX.size:
+            raise ReportError('truncated result record')
+
+        (suite, status, test, variant, nb_samples, flags) = ENTRY_PREFIX.unpack_from(data, offset)
+        offset += ENTRY_PREFIX.size
+
+        width = 'H' if flags & REPORT_ENTRY_16BIT else 'I'
+        samples = struct.Struct(f'<{2 * nb_samples}{width}')
+        if end < offset + samples.size:
+            raise ReportError('truncated result record')
+
+        values = samples.unpack_from(data, offset)
+        report.entries.append(Entry(
+            suite,
+            status,
+            test,
+            variant,
+            list(values[:nb_samples]),
+            list(values[nb_samples:]),
+        ))
+        offset += samples.size
+
+    return report
+
+
+def serialize(report):
+    """Build the bytes of a record, the way the ROMs lay it out."""
+
+    entries = bytearray()
+    for entry in report.entries:
+        nb_samples = len(entry.measured)
+        expected = (entry.expected + [0] * nb_samples)[:nb_samples]
+        flags = REPORT_ENTRY_16BIT if all(x <= 0xFFFF for x in entry.measured + expected) else 0
+        width = 'H' if flags & REPORT_ENTRY_16BIT else 'I'
+        entries += ENTRY_PREFIX.pack(entry.suite, entry.status, entry.test, entry.variant, nb_samples, flags)
+        entries += struct.pack(f'<{2 * nb_samples}{width}', *entry.measured, *expected)
+
+    data = bytearray(HEADER.pack(
+        REPORT_MAGIC,
+        report.version,
+        len(entries),
+        report.nb_tests,
+        len(report.entries),
+        report.nb_pass,
+        report.nb_fail,
+        report.state,
+    ))
+
+    return bytes(data + entries)
+
+
+def load(path, offset=None):
+    with open(path, 'rb') as f:
+        return parse(f.read(), offset)
+
+
+def _enum(header, name, prefix):
+    with open(os.path.join(ROOT, 'include', header)) as f:
+        source = f.read()
+
+    body = re.search(r'enum\s+' + name + r'\s*{(.*?)}', source, re.S).group(1)
+
+    values = {}
+    value = 0
+    for member in re.finditer(r'(' + prefix + r'\w+)(?:\s*=\s*(\w+))?\s*,', body):
+        if member.group(2) is not None:
+            value = int(member.group(2), 0)
+        values[value] = member.group(1)
+        value += 1
+    return values
+
+
+def suite_names():
+    """Map suite ids to their `enum report_suite` name."""
+    return _enum('report.h', 'report_suite', 'REPORT_SUITE_')
+
+
+def variant_name(variant, kinds, harness=True, indexed=False):
+    """Spell a variant, eg. `ROM_WITH_PREFETCH THUMB HARNESS_WS(1, 0)`.
+
+    Variants of suites that don't run through the harness are spelled as a
+    kind if they are one, and as a raw value otherwise. Those of indexed suites
+    are spelled as a case index.
+    """
+
+    if indexed:
+        return f'CASE {variant}'
+    if not harness:
+        return kinds[variant].removeprefix('TEST_KIND_') if variant in kinds else f'0x{variant:04X}'
+
+    kind = variant & 0x7F
+    name = kinds.get(kind, str(kind)).removeprefix('TEST_KIND_')
+    if variant & HARNESS_VARIANT_THUMB:
+        name += ' THUMB'
+    if variant >> 8:
+        name += ' ' + harness_ws(variant >> 8)
+    return name
+
+
+def harness_ws(waitstates):
+    """Spell a waitstate setting the way the harness tables do."""
+    return f'HARNESS_WS({waitstates & 3}, {waitstates >> 2})'
+
+
+def kind_names():
+    """Map test kinds to their `enum test_kind` name."""
+    return _enum('test.h', 'test_kind', 'TEST_KIND_')
@@ -0,0 +1,331 @@
+#!/usr/bin/env python3
+
+################################################################################
+##
+##  This file is part of the Hades GBA Emulator, and is made available under
+##  the terms of the GNU General Public License version 2.
+##
+##  Copyright (C) 2021-2024 - The Hades Authors
+##
+################################################################################
+
+"""Run the test ROMs against one or more emulator builds.
+
+Every ROM is run on every emulator build, in parallel. The emulator is started
+with a command template, in which the following placeholders are replaced:
+
+    {emulator}  Path to the emulator build
+    {rom}       Path to a private copy of the ROM
+    {sav}       Path of the save file next to that copy
+    {dir}       Private working directory of the run
+
+The result record is read from the save file, which the runner watches while
+the emulator runs: it is stopped as soon as the record is complete.
+
+    ./tools/runner.py -e ~/hades/build/hades -c '{emulator} --headless {rom}' roms/*.gba
+    ./tools/runner.py -e old=./hades-1.0 -e new=./hades-1.1 --junit out.xml roms/hades-tests.gba
+
+Outcomes are cached, keyed on the hash of the ROM, of the emulator build and of
+the command template, so unchanged pairs are never run twice.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+import xml.etree.ElementTree as ET
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass
+
+import hades_report
+
+CACHE_VERSION = 1
+POLL_INTERVAL = 0.1
+
+OUTCOME_DONE = 'done'               # The record is complete
+OUTCOME_INCOMPLETE = 'incomplete'   # The emulator exited before the record was complete
+OUTCOME_TIMEOUT = 'timeout'         # The emulator was killed before the record was complete
+OUTCOME_ERROR = 'error'             # The emulator couldn't be started
+
+
+@dataclass
+class Emulator:
+    name: str
+    path: str
+    hash: str
+
+
+@dataclass
+class Rom:
+    name: str
+    path: str
+    hash: str
+
+
+def sha256(path):
+    h = hashlib.sha256()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), b''):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def parse_emulator(arg):
+    name, sep, path = arg.partition('=')
+    if not sep:
+        name, path = os.path.basename(arg), arg
+
+    resolved = shutil.which(path) or path
+    if not os.path.isfile(resolved):
+        raise SystemExit(f'{path}: no such emulator')
+
+    return Emulator(name, resolved, sha256(resolved))
+
+
+def report_to_json(report):
+    return {
+        'nb_tests': report.nb_tests,
+        'nb_pass': report.nb_pass,
+        'nb_fail': report.nb_fail,
+        'entries': [
+            {
+                'suite': entry.suite,
+                'status': entry.status,
+                'test': entry.test,
+                'variant': entry.variant,
+                'measured': entry.measured,
+                'expected': entry.expected,
+            }
+            for entry in report.entries
+        ],
+    }
+
+
+def read_report(path):
+    try:
+        return hades_report.load(path, 0)
+    except (OSError, hades_report.ReportError):
+        return None
+
+
+def run_one(command, emulator, rom, timeout):
+    """Run `rom` on `emulator` and return its outcome."""
+
+    with tempfile.TemporaryDirectory(prefix='hades-tests-') as workdir:
+        stem = os.path.splitext(os.path.basename(rom.path))[0]
+        rom_path = os.path.join(workdir, stem + '.gba')
+        sav_path = os.path.join(workdir, stem + '.sav')
+        shutil.copyfile(rom.path, rom_path)
+
+        argv = [
+            arg.format(emulator=emulator.path, rom=rom_path, sav=sav_path, dir=workdir)
+            for arg in shlex.split(command)
+        ]
+
+        start = time.monotonic()
+        try:
+            proc = subprocess.Popen(
+                argv,
+                cwd=workdir,
+                stdin=subprocess.DEVNULL,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.STDOUT,
+            )
+        except OSError as e:
+            return {'outcome': OUTCOME_ERROR, 'message': str(e), 'duration': 0.0}
+
+        # Drain the output in the background so a chatty emulator never blocks.
+        output = []
+        reader = threading.Thread(target=lambda: output.append(proc.stdout.read()), daemon=True)
+        reader.start()
+
+        outcome = None
+        report = None
+        while outcome is None:
+            exited = proc.poll() is not None
+
+            report = read_report(sav_path)
+            if report is not None and report.done:
+                outcome = OUTCOME_DONE
+            elif exited:
+                outcome = OUTCOME_INCOMPLETE
+            elif time.monotonic() - start > timeout:
+                outcome = OUTCOME_TIMEOUT
+            else:
+                time.sleep(POLL_INTERVAL)
+
+        if proc.poll() is None:
+            proc.kill()
+        proc.wait()
+        reader.join()
+
+        result = {
+            'outcome': outcome,
+            'exit_code': proc.returncode,
+            'duration': round(time.monotonic() - start, 3),
+            'output': output[0].decode(errors='replace')[-4096:] if output and output[0] else '',
+        }
+        if report is not None:
+            result['report'] = report_to_json(report)
+        return result
+
+
+class Cache:
+    def __init__(self, path):
+        self.path = path
+        self.lock = threading.Lock()
+        self.entries = {}
+
+        if path is not None and os.path.exists(path):
+            try:
+                with open(path) as f:
+                    data = json.load(f)
+                if data.get('version') == CACHE_VERSION:
+                    self.entries = data['entries']
+            except (OSError, ValueError, KeyError):
+                pass
+
+    @staticmethod
+    def key(command, emulator, rom):
+        return f'{rom.hash}:{emulator.hash}:{hashlib.sha256(command.encode()).hexdigest()}'
+
+    def get(self, key):
+        with self.lock:
+            return self.entries.get(key)
+
+    def put(self, key, result):
+        with self.lock:
+            self.entries[key] = result
+
+    def save(self):
+        if self.path is None:
+            return
+
+        os.makedirs(os.path.dirname(os.path.abspath(self.path)), exist_ok=True)
+        tmp = self.path + '.tmp'
+        with open(tmp, 'w') as f:
+            json.dump({'version': CACHE_VERSION, 'entries': self.entries}, f)
+        os.replace(tmp, self.path)
+
+
+def passed(result):
+    if result['outcome'] != OUTCOME_DONE:
+        return False
+    report = result['report']
+    return report['nb_fail'] == 0 and all(entry['status'] != hades_report.REPORT_STATUS_FAIL for entry in report['entries'])
+
+
+def write_junit(path, results, suites, kinds):
+    root = ET.Element('testsuites')
+
+    for result in results:
+        suite = ET.SubElement(root, 'testsuite', name=f'{result["emulator"]}/{result["rom"]}')
+        nb_tests = nb_failures = nb_errors = nb_skipped = 0
+
+        if result['outcome'] != OUTCOME_DONE:
+            case = ET.SubElement(suite, 'testcase', classname=result['emulator'], name=result['rom'])
+            error = ET.SubElement(case, 'error', message=result['outcome'])
+            error.text = result.get('message', result.get('output', ''))
+            nb_tests += 1
+            nb_errors += 1
+
+        for entry in result.get('report', {}).get('entries', []):
+            suite_name = suites.get(entry['suite'], f'SUITE_{entry["suite"]}').removeprefix('REPORT_SUITE_')
+            harness = suites.get(entry['suite']) in hades_report.HARNESS_SUITES
+            indexed = suites.get(entry['suite']) in hades_report.INDEXED_SUITES
+            name = f'{entry["test"]:02} ' + hades_report.variant_name(entry['variant'], kinds, harness, indexed)
+
+            case = ET.SubElement(suite, 'testcase', classname=f'{result["emulator"]}.{suite_name}', name=name)
+            nb_tests += 1
+
+            if entry['status'] == hades_report.REPORT_STATUS_NO_GOLDEN:
+                ET.SubElement(case, 'skipped', message='no golden')
+                nb_skipped += 1
+            elif entry['status'] == hades_report.REPORT_STATUS_FAIL:
+                failure = ET.SubElement(case, 'failure', message='unexpected samples')
+                failure.text = 'measured: {}\nexpected: {}'.format(
+                    ' '.join(f'0x{x:X}' for x in entry['measured']),
+                    ' '.join(f'0x{x:X}' for x in entry['expected']),
+                )
+                nb_failures += 1
+
+        suite.set('tests', str(nb_tests))
+        suite.set('failures', str(nb_failures))
+        suite.set('errors', str(nb_errors))
+        suite.set('skipped', str(nb_skipped))
+        suite.set('time', str(result['duration']))
+
+    ET.indent(root)
+    ET.ElementTree(root).write(path, encoding='utf-8', xml_declaration=True)
+
+
+def main():
+    default_cache = os.path.join(
+        os.environ.get('XDG_CACHE_HOME', os.path.expanduser('~/.cache')),
+        'hades-tests',
+        'results.json',
+    )
+
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('roms', nargs='+', help='ROMs to run')
+    parser.add_argument('-e', '--emulator', action='append', required=True, help='emulator build, as PATH or NAME=PATH (repeatable)')
+    parser.add_argument('-c', '--command', default='{emulator} {rom}', help='command template (default: %(default)s)')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(), help='number of parallel runs (default: %(default)s)')
+    parser.add_argument('-t', '--timeout', type=float, default=60.0, help='timeout of a run, in seconds (default: %(default)s)')
+    parser.add_argument('--cache', default=default_cache, help='cache file (default: %(default)s)')
+    parser.add_argument('--no-cache', action='store_true', help='neither read nor write the cache')
+    parser.add_argument('--rerun', action='store_true', help='ignore cached outcomes, but update the cache')
+    parser.add_argument('--junit', help='write a JUnit report to this file')
+    parser.add_argument('--json', help='write a JSON report to this file')
+    args = parser.parse_args()
+
+    emulators = [parse_emulator(arg) for arg in args.emulator]
+    roms = [Rom(os.path.basename(path), path, sha256(path)) for path in args.roms]
+    cache = Cache(None if args.no_cache else args.cache)
+
+    def job(emulator, rom):
+        key = Cache.key(args.command, emulator, rom)
+        result = None if args.rerun else cache.get(key)
+        cached = result is not None
+
+        if not cached:
+            result = run_one(args.command, emulator, rom, args.timeout)
+
+            # Timeouts and launch failures depend on the host, don't keep them.
+            if result['outcome'] in (OUTCOME_DONE, OUTCOME_INCOMPLETE):
+                cache.put(key, result)
+
+        result = dict(result, emulator=emulator.name, rom=rom.name, cached=cached)
+        status = 'PASS' if passed(result) else 'FAIL' if result['outcome'] == OUTCOME_DONE else result['outcome'].upper()
+        print(f'{emulator.name:<16} {rom.name:<32} {status}{" (cached)" if cached else ""}', flush=True)
+        return result
+
+    # Each worker takes the next pending run as soon as it's idle, so a slow
+    # ROM never holds back the others.
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        futures = [pool.submit(job, emulator, rom) for emulator in emulators for rom in roms]
+        results = [future.result() for future in futures]
+
+    cache.save()
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=4)
+
+    if args.junit:
+        write_junit(args.junit, results, hades_report.suite_names(), hades_report.kind_names())
+
+    nb_passed = sum(passed(result) for result in results)
+    print(f'Total: {nb_passed}/{len(results)}')
+    return 0 if nb_passed == len(results) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
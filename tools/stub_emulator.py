@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+
+################################################################################
+##
+##  This file is part of the Hades GBA Emulator, and is made available under
+##  the terms of the GNU General Public License version 2.
+##
+##  Copyright (C) 2021-2024 - The Hades Authors
+##
+################################################################################
+
+"""Stand-in for an emulator, to exercise `tools/runner.py` without one.
+
+It doesn't run anything: it writes, next to the ROM, the save file a real
+emulator would have produced, with one passing entry per suite. Like a real
+emulator, it keeps running once the record is complete until the runner stops
+it, unless `--exit` is given.
+
+    ./tools/runner.py -e tools/stub_emulator.py -c '{emulator} {rom}' roms/*.gba
+    ./tools/runner.py -e tools/stub_emulator.py -c '{emulator} --fail 4:1 {rom}' roms/*.gba
+"""
+
+import argparse
+import os
+import sys
+import time
+
+import hades_report
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('rom', help='ROM to "run"')
+    parser.add_argument('--fail', action='append', default=[], help='make test SUITE:TEST fail (repeatable)')
+    parser.add_argument('--delay', type=float, default=0.0, help='seconds to wait before writing the record')
+    parser.add_argument('--hang', action='store_true', help='never complete the record')
+    parser.add_argument('--exit', action='store_true', help='exit once the record is written')
+    args = parser.parse_args()
+
+    failing = {tuple(int(x, 0) for x in arg.split(':')) for arg in args.fail}
+
+    report = hades_report.Report(
+        hades_report.REPORT_VERSION,
+        0,
+        0,
+        0,
+        hades_report.REPORT_STATE_RUNNING if args.hang else hades_report.REPORT_STATE_DONE,
+    )
+
+    for suite in sorted(hades_report.suite_names()):
+        fail = (suite, 1) in failing
+        report.entries.append(hades_report.Entry(
+            suite,
+            hades_report.REPORT_STATUS_FAIL if fail else hades_report.REPORT_STATUS_PASS,
+            1,
+            0,
+            [0xDEAD if fail else 0x0000],
+            [0x0000],
+        ))
+        report.nb_tests += 1
+        report.nb_fail += fail
+        report.nb_pass += not fail
+
+    time.sleep(args.delay)
+
+    with open(os.path.splitext(args.rom)[0] + '.sav', 'wb') as f:
+        f.write(hades_report.serialize(report))
+
+    if not args.exit:
+        while True:
+            time.sleep(1)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,941 @@
+#!/usr/bin/env python3
+
+################################################################################
+##
+##  This file is part of the Hades GBA Emulator, and is made available under
+##  the terms of the GNU General Public License version 2.
+##
+##  Copyright (C) 2021-2024 - The Hades Authors
+##
+################################################################################
+
+"""ARM7TDMI timing model, to compute the expected values of timing tests.
+
+Given a straight-line sequence of ARM or THUMB instructions, the region the
+code runs from, the value of WAITCNT and whether the GamePak prefetcher is
+enabled, it counts the cycles spent by each instruction, keeping track of the
+N/S/I cycles and of the wait states of every memory access, and computes the
+values read from the timers along the way.
+
+    ./tools/timing.py --region rom --waitcnt 0x0000 test.s
+    ./tools/timing.py --suite source/timer-basic.c
+    ./tools/timing.py --suite source/timer-basic.c --check
+
+With `--suite`, every harness test of a suite written in inline assembly is
+run for every kind it is registered with, and the expected-value tables are
+printed in the format the suites use. `--check` compares them with the tables
+in the file instead.
+
+The model:
+  - Every instruction first fetches the next opcode, then does its data
+    accesses, then its internal (I) cycles.
+  - A code fetch is sequential (S) only if the previous bus access was the
+    fetch of the previous opcode, so the fetch following a load or a store is
+    non-sequential (N).
+  - 32-bit accesses on a 16-bit bus are split in an access of the requested
+    type followed by a sequential one.
+  - Writes take effect at the end of their last cycle and reads sample their
+    value at the beginning of their first one. A timer enabled by a write
+    ending at cycle T reads `reload + (t - T - 1) / prescaler` at cycle t.
+  - With the prefetcher enabled, the GamePak fetches the following halfwords,
+    up to 8, during every cycle the CPU doesn't use the GamePak bus. Opcodes
+    found in the buffer take 1 cycle per halfword; a data access to the
+    GamePak or a fetch outside of the buffer flushes it.
+  - Branches are taken and the next line is assumed to be their target, so
+    loops must be unrolled.
+
+It is calibrated against the goldens of `source/timer-basic.c`, measured on
+real hardware.
+"""
+
+import argparse
+import re
+import sys
+from dataclasses import dataclass, field
+
+REGION_BASES = {
+    'bios': 0x00000000,
+    'ewram': 0x02000000,
+    'iwram': 0x03000000,
+    'rom': 0x08000000,
+    'rom_ws1': 0x0A000000,
+    'rom_ws2': 0x0C000000,
+}
+
+# `enum test_kind` -> (code region, prefetcher enabled, shift of the region's
+# fields in WAITCNT), in the order of `REGISTER_HARNESS_TEST_ALL_KINDS()`
+KIND_CONFIGS = {
+    'TEST_KIND_ROM_WITHOUT_PREFETCH': ('rom', False, 2),
+    'TEST_KIND_ROM_WITH_PREFETCH': ('rom', True, 2),
+    'TEST_KIND_ROM_WS1_WITHOUT_PREFETCH': ('rom_ws1', False, 5),
+    'TEST_KIND_ROM_WS1_WITH_PREFETCH': ('rom_ws1', True, 5),
+    'TEST_KIND_ROM_WS2_WITHOUT_PREFETCH': ('rom_ws2', False, 8),
+    'TEST_KIND_ROM_WS2_WITH_PREFETCH': ('rom_ws2', True, 8),
+    'TEST_KIND_IWRAM': ('iwram', False, None),
+    'TEST_KIND_EWRAM': ('ewram', False, None),
+}
+
+HARNESS_WAITSTATES_MAX = 8
+
+WAITCNT_PREFETCH = 1 << 14
+
+TIMER_BASE = 0x04000100
+TIMER_PRESCALERS = (1, 64, 256, 1024)
+
+CONDITIONS = r'(?:eq|ne|cs|hs|cc|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le|al)'
+DATA_PROCESSING = {
+    'and', 'eor', 'sub', 'rsb', 'add', 'adc', 'sbc', 'rsc',
+    'tst', 'teq', 'cmp', 'cmn', 'orr', 'mov', 'bic', 'mvn',
+    'lsl', 'lsr', 'asr', 'ror', 'neg',
+}
+NO_DESTINATION = {'tst', 'teq', 'cmp', 'cmn'}
+
+
+class ModelError(Exception):
+    pass
+
+
+@dataclass
+class Waitcnt:
+    """Cycles per access of each GamePak region, decoded from WAITCNT."""
+
+    value: int = 0x0000
+
+    def sram(self):
+        return (4, 3, 2, 8)[self.value & 3] + 1
+
+    def rom(self, ws, seq):
+        if ws == 0:
+            return ((2, 1)[(self.value >> 4) & 1] if seq else (4, 3, 2, 8)[(self.value >> 2) & 3]) + 1
+        if ws == 1:
+            return ((4, 1)[(self.value >> 7) & 1] if seq else (4, 3, 2, 8)[(self.value >> 5) & 3]) + 1
+        return ((8, 1)[(self.value >> 10) & 1] if seq else (4, 3, 2, 8)[(self.value >> 8) & 3]) + 1
+
+    @property
+    def prefetch(self):
+        return bool(self.value & WAITCNT_PREFETCH)
+
+
+def region_of(address):
+    """Return (name, bus width in bytes) of the region `address` belongs to."""
+
+    page = (address >> 24) & 0xFF
+    if page == 0x00:
+        return 'bios', 4
+    if page == 0x02:
+        return 'ewram', 2
+    if page == 0x03:
+        return 'iwram', 4
+    if page == 0x04:
+        return 'io', 4
+    if page == 0x05:
+        return 'palram', 2
+    if page == 0x06:
+        return 'vram', 2
+    if page == 0x07:
+        return 'oam', 4
+    if 0x08 <= page <= 0x0D:
+        return f'ws{(page - 0x08) // 2}', 2
+    if 0x0E <= page <= 0x0F:
+        return 'sram', 1
+    return 'open bus', 4
+
+
+def is_gamepak(region):
+    return region.startswith('ws')
+
+
+class Timers:
+    def __init__(self):
+        self.reload = [0] * 4
+        self.control = [0] * 4
+        self.start = [None] * 4     # Cycle at which the running timer was enabled
+        self.frozen = [0] * 4       # Counter of the stopped timer
+
+    def counter(self, idx, t):
+        if self.start[idx] is None:
+            return self.frozen[idx]
+
+        # Count-up timers only tick on their neighbour's overflow, which isn't
+        # modeled: they keep their reload value.
+        if idx and self.control[idx] & 0x4:
+            return self.reload[idx]
+
+        reload = self.reload[idx]
+        ticks = max(0, t - self.start[idx] - 1) // TIMER_PRESCALERS[self.control[idx] & 3]
+        return reload + ticks % (0x10000 - reload)
+
+    def read16(self, address, t):
+        idx, reg = divmod(address - TIMER_BASE, 4)
+        return self.counter(idx, t) if reg == 0 else self.control[idx]
+
+    def write16(self, address, value, t):
+        idx, reg = divmod(address - TIMER_BASE, 4)
+        if reg == 0:
+            self.reload[idx] = value
+            return
+
+        running = self.start[idx] is not None
+        if value & 0x80 and not running:
+            self.frozen[idx] = self.reload[idx]
+            self.start[idx] = t
+        elif not value & 0x80 and running:
+            self.frozen[idx] = self.counter(idx, t)
+            self.start[idx] = None
+        self.control[idx] = value & 0xFFFF
+
+
+class Prefetcher:
+    """GamePak prefetch buffer."""
+
+    SIZE = 8
+
+    def __init__(self, waitcnt):
+        self.waitcnt = waitcnt
+        self.reset(None)
+
+    def reset(self, head):
+        self.head = head        # Address of the next halfword to fetch
+        self.count = 0          # Halfwords ready in the buffer
+        self.progress = 0       # Cycles already spent fetching `head`
+
+    def idle(self, cycles):
+        """Let the prefetcher run while the CPU isn't on the GamePak bus."""
+
+        if self.head is None:
+            return
+
+        ws = (self.head >> 25) & 3
+        for _ in range(cycles):
+            if self.count == self.SIZE:
+                break
+            self.progress += 1
+            if self.progress == self.waitcnt.rom(ws, True):
+                self.count += 1
+                self.head += 2
+                self.progress = 0
+
+    def fetch(self, address):
+        """Return the cycles the halfword at `address` costs, or None on a miss."""
+
+        if self.head is None:
+            return None
+
+        first = self.head - 2 * self.count
+        if self.count and address == first:
+            self.count -= 1
+            return 1
+
+        if not self.count and address == self.head:
+            ws = (self.head >> 25) & 3
+            cycles = self.waitcnt.rom(ws, True) - self.progress
+            self.head += 2
+            self.progress = 0
+            return cycles
+
+        return None
+
+
+@dataclass
+class Step:
+    line: str
+    start: int
+    cycles: int
+    detail: list = field(default_factory=list)
+
+
+@dataclass
+class Result:
+    cycles: int
+    steps: list
+    registers: list
+    loads: list
+    samples: dict
+
+
+class Model:
+    """Run a straight-line instruction sequence and count its cycles."""
+
+    def __init__(self, region='iwram', waitcnt=0x0000, prefetch=None, thumb=False, registers=None):
+        if isinstance(region, str):
+            region = REGION_BASES[region]
+
+        if prefetch is not None:
+            waitcnt = (waitcnt | WAITCNT_PREFETCH) if prefetch else (waitcnt & ~WAITCNT_PREFETCH)
+
+        self.code_base = region
+        self.waitcnt = Waitcnt(waitcnt)
+        self.thumb = thumb
+        self.initial_registers = list(registers or [None] * 16)
+
+    # Bus
+
+    def access_cycles(self, address, width, seq):
+        """Cycles of an access of `width` bytes, and the detail of each part."""
+
+        region, bus = region_of(address)
+        parts = max(1, width // bus) if region != 'sram' else 1
+
+        total = 0
+        for i in range(parts):
+            s = seq or i > 0
+            if is_gamepak(region):
+                cycles = self.waitcnt.rom(int(region[2]), s)
+            elif region == 'sram':
+                cycles = self.waitcnt.sram()
+            elif region == 'ewram':
+                cycles = 3
+            else:
+                cycles = 1
+            total += cycles
+        return total
+
+    def bus(self, kind, address, width, seq=False):
+        """Perform an access, advancing the time. Return its starting cycle."""
+
+        start = self.time
+        region, _ = region_of(address)
+        gamepak = is_gamepak(region)
+
+        if kind == 'fetch':
+            seq = self.last == ('fetch', address)
+
+            if gamepak and self.waitcnt.prefetch:
+                cycles = 0
+                for half in range(0, width, 2):
+                    hit = self.prefetcher.fetch(address + half)
+                    if hit is None:
+                        cycles += self.access_cycles(address + half, 2, seq or half > 0)
+                        self.prefetcher.reset(address + half + 2)
+                    else:
+                        cycles += hit
+                desc = f'{cycles}{"S" if seq else "N"}P'
+            else:
+                cycles = self.access_cycles(address, width, seq)
+                desc = f'{cycles}{"S" if seq else "N"}' + ('S' if width > region_of(address)[1] and not seq else '')
+
+            self.last = ('fetch', address + width)
+        else:
+            cycles = self.access_cycles(address, width, seq)
+            desc = f'{cycles}{"S" if seq else "N"} {"read" if kind == "read" else "write"} {region}'
+            self.last = (kind, address + width)
+
+            if gamepak:
+                self.prefetcher.reset(None)
+
+        if not gamepak:
+            self.prefetcher.idle(cycles)
+
+        self.time += cycles
+        self.step.detail.append(desc)
+        self.step.cycles += cycles
+        return start
+
+    def internal(self, cycles=1):
+        if not cycles:
+            return
+        self.prefetcher.idle(cycles)
+        self.time += cycles
+        self.last = ('internal', None)
+        self.step.detail.append(f'{cycles}I')
+        self.step.cycles += cycles
+
+    # Memory
+
+    def read(self, address, width, seq=False):
+        start = self.bus('read', address, width, seq)
+        address &= ~(width - 1)
+
+        if TIMER_BASE <= address < TIMER_BASE + 0x10:
+            value = 0
+            for off in range(0, max(width, 2), 2):
+                value |= self.timers.read16(address + off, start) << (8 * off)
+            value &= (1 << (8 * width)) - 1
+            self.loads.append((self.step.line, address, value))
+            return value
+
+        value = 0
+        for off in range(width):
+            byte = self.memory.get(address + off)
+            if byte is None:
+                return None
+            value |= byte << (8 * off)
+        return value
+
+    def write(self, address, width, value, seq=False):
+        self.bus('write', address, width, seq)
+        end = self.time
+        address &= ~(width - 1)
+
+        if value is None:
+            for off in range(width):
+                self.memory.pop(address + off, None)
+            return
+
+        for off in range(width):
+            self.memory[address + off] = (value >> (8 * off)) & 0xFF
+
+        if TIMER_BASE <= address < TIMER_BASE + 0x10:
+            for off in range(0, width, 2) if width > 1 else (0,):
+                half = address + off
+                self.timers.write16(half & ~1, (value >> (8 * off)) & 0xFFFF, end)
+
+    # Operands
+
+    def reg(self, name):
+        name = name.strip().lower()
+        aliases = {'sp': 13, 'lr': 14, 'pc': 15, 'ip': 12, 'fp': 11, 'sl': 10}
+        if name in aliases:
+            return aliases[name]
+        if re.fullmatch(r'r\d+', name):
+            return int(name[1:])
+        raise ModelError(f'unknown register "{name}"')
+
+    @staticmethod
+    def imm(text):
+        return int(text.strip().lstrip('#'), 0) & 0xFFFFFFFF
+
+    def value_of(self, operand):
+        operand = operand.strip()
+        if operand.startswith('#'):
+            return self.imm(operand)
+        return self.regs[self.reg(operand)]
+
+    def operand2(self, operands):
+        """Evaluate a shifter operand. Return (value, extra internal cycles)."""
+
+        value = self.value_of(operands[0])
+        if len(operands) == 1:
+            return value, 0
+
+        shift = operands[1].strip().lower().split()
+        kind = shift[0]
+        if kind == 'rrx':
+            return None, 0
+
+        amount_text = shift[1]
+        extra = 0 if amount_text.startswith('#') else 1
+        amount = self.value_of(amount_text)
+        if value is None or amount is None:
+            return None, extra
+        return shift_value(kind, value, amount & 0xFF), extra
+
+    def literal(self, value):
+        """Place `value` in the literal pool and return its address."""
+
+        if value not in self.pool:
+            self.pool[value] = self.pool_base + 4 * len(self.pool)
+            address = self.pool[value]
+            for off in range(4):
+                self.memory[address + off] = (value >> (8 * off)) & 0xFF
+        return self.pool[value]
+
+    def address(self, operand):
+        """Decode a `[rn, offset]` operand. Return (address, base, writeback)."""
+
+        match = re.fullmatch(r'\[([^\]]*)\](!?)(?:\s*,\s*(.+))?', operand.strip())
+        if not match:
+            raise ModelError(f'bad address "{operand}"')
+
+        inner = split_operands(match.group(1))
+        base = self.reg(inner[0])
+        base_value = self.regs[base]
+        if base == 15:
+            base_value = self.pc + (4 if self.thumb else 8)
+
+        def offset(parts):
+            if not parts:
+                return 0
+            text = parts[0].strip()
+            sign = -1 if text.startswith('-') or text.startswith('#-') else 1
+            text = text.replace('-', '', 1)
+            if text.startswith('#'):
+                return sign * self.imm(text)
+            value, _ = self.operand2([text] + parts[1:])
+            return None if value is None else sign * value
+
+        if match.group(3) is not None:
+            # Post-indexed
+            off = offset(split_operands(match.group(3)))
+            if base_value is None:
+                return None, base, None
+            return base_value, base, None if off is None else (base_value + off) & 0xFFFFFFFF
+
+        off = offset(inner[1:])
+        if base_value is None or off is None:
+            return None, base, None
+        address = (base_value + off) & 0xFFFFFFFF
+        return address, base, address if match.group(2) else None
+
+    # Instructions
+
+    def run(self, source):
+        lines = []
+        for line in source.splitlines():
+            line = re.split(r'//|@|;', line)[0].strip()
+            if not line or line.endswith(':') or line.startswith('.'):
+                continue
+            lines.append(line)
+
+        self.time = 0
+        self.last = None
+        self.regs = list(self.initial_registers)
+        self.memory = {}
+        self.timers = Timers()
+        self.prefetcher = Prefetcher(self.waitcnt)
+        self.loads = []
+        self.samples = {}
+        self.steps = []
+        self.pc = self.code_base
+        self.pool = {}
+        self.pool_base = self.code_base + (2 if self.thumb else 4) * len(lines)
+        self.pool_base = (self.pool_base + 3) & ~3
+
+        size = 2 if self.thumb else 4
+        for line in lines:
+            self.step = Step(line, self.time, 0)
+            self.steps.append(self.step)
+
+            # The opcode fetched while this instruction executes is the one
+            # two instructions ahead.
+            self.bus('fetch', self.pc + 2 * size, size)
+            self.execute(line)
+            self.pc += size
+
+        return Result(self.time, self.steps, self.regs, self.loads, self.samples)
+
+    def execute(self, line):
+        mnemonic, _, rest = line.partition(' ')
+        mnemonic = mnemonic.lower()
+        operands = split_operands(rest)
+
+        if mnemonic == 'nop':
+            return
+
+        match = re.fullmatch(r'(ldr|str)' + CONDITIONS + r'?(sb|sh|h|b)?' + CONDITIONS + r'?', mnemonic)
+        if match:
+            return self.load_store(match.group(1), match.group(2) or '', operands)
+
+        match = re.fullmatch(r'(ldm|stm)' + CONDITIONS + r'?(ia|ib|da|db|fd|ed|fa|ea)?' + CONDITIONS + r'?', mnemonic)
+        if match or mnemonic in ('push', 'pop'):
+            return self.block(mnemonic, match, operands)
+
+        match = re.fullmatch(r'(swpb?)' + CONDITIONS + r'?', mnemonic)
+        if match:
+            return self.swap(match.group(1) == 'swpb', operands)
+
+        match = re.fullmatch(r'(b|bl|bx)' + CONDITIONS + r'?', mnemonic)
+        if match:
+            return self.branch()
+
+        match = re.fullmatch(r'(mul|mla|umull|umlal|smull|smlal)' + CONDITIONS + r'?s?', mnemonic)
+        if match:
+            return self.multiply(match.group(1), operands)
+
+        match = re.fullmatch(r'(mrs|msr)' + CONDITIONS + r'?', mnemonic)
+        if match:
+            if match.group(1) == 'mrs':
+                self.regs[self.reg(operands[0])] = None
+            return
+
+        match = re.fullmatch(r'(\w{3})' + CONDITIONS + r'?s?', mnemonic)
+        if match and match.group(1) in DATA_PROCESSING:
+            return self.data_processing(match.group(1), operands)
+
+        raise ModelError(f'unsupported instruction "{line}"')
+
+    def set_reg(self, operand, value):
+        operand = operand.strip()
+        if operand.startswith('%['):
+            # Inline assembly output operand: this is how tests return samples
+            self.samples[operand[2:-1]] = value
+            return
+
+        reg = self.reg(operand)
+        self.regs[reg] = None if value is None else value & 0xFFFFFFFF
+        if reg == 15:
+            self.branch_refill()
+
+    def data_processing(self, op, operands):
+        if op in NO_DESTINATION:
+            _, extra = self.operand2(operands[1:])
+            return self.internal(extra)
+
+        if op in ('lsl', 'lsr', 'asr', 'ror'):
+            # THUMB shifts, or their UAL spelling in ARM
+            if len(operands) == 2:
+                operands = [operands[0], operands[0], operands[1]]
+            value = self.value_of(operands[1])
+            amount = self.value_of(operands[2])
+            extra = 0 if operands[2].strip().startswith('#') else 1
+            result = None if value is None or amount is None else shift_value(op, value, amount & 0xFF)
+            self.internal(extra)
+            return self.set_reg(operands[0], result)
+
+        if op in ('mov', 'mvn'):
+            value, extra = self.operand2(operands[1:])
+            if op == 'mvn' and value is not None:
+                value = ~value & 0xFFFFFFFF
+            self.internal(extra)
+            return self.set_reg(operands[0], value)
+
+        if op == 'neg':
+            value = self.value_of(operands[1])
+            return self.set_reg(operands[0], None if value is None else -value)
+
+        if len(operands) == 2:
+            # THUMB two-operand form
+            operands = [operands[0], operands[0], operands[1]]
+
+        a = self.value_of(operands[1])
+        b, extra = self.operand2(operands[2:])
+        self.internal(extra)
+
+        if a is None or b is None:
+            return self.set_reg(operands[0], None)
+
+        result = {
+            'and': lambda: a & b,
+            'eor': lambda: a ^ b,
+            'sub': lambda: a - b,
+            'rsb': lambda: b - a,
+            'add': lambda: a + b,
+            'orr': lambda: a | b,
+            'bic': lambda: a & ~b,
+        }.get(op, lambda: None)()
+        self.set_reg(operands[0], result)
+
+    def load_store(self, op, suffix, operands):
+        width = {'': 4, 'b': 1, 'sb': 1, 'h': 2, 'sh': 2}[suffix]
+        target = operands[0]
+
+        if op == 'ldr' and operands[1].strip().startswith('='):
+            address = self.literal(self.imm(operands[1].strip()[1:]))
+            base, writeback = 15, None
+        else:
+            address, base, writeback = self.address(','.join(operands[1:]))
+
+        if address is None:
+            raise ModelError(f'can\'t resolve the address of "{self.step.line}"')
+
+        if op == 'ldr':
+            value = self.read(address, width)
+            self.internal(1)
+            if value is not None and suffix in ('sb', 'sh'):
+                bits = 8 * width
+                if value & (1 << (bits - 1)):
+                    value -= 1 << bits
+            if writeback is not None:
+                self.regs[base] = writeback
+            self.set_reg(target, value)
+        else:
+            value = self.value_of(target)
+            self.write(address, width, value)
+            if writeback is not None:
+                self.regs[base] = writeback
+
+    def block(self, mnemonic, match, operands):
+        if mnemonic in ('push', 'pop'):
+            load = mnemonic == 'pop'
+            base, writeback, mode = 13, True, 'ia' if load else 'db'
+            reglist = ','.join(operands)
+        else:
+            load = match.group(1) == 'ldm'
+            mode = match.group(2) or 'ia'
+            mode = {
+                'fd': 'ia' if load else 'db',
+                'ed': 'ib' if load else 'da',
+                'fa': 'da' if load else 'ib',
+                'ea': 'db' if load else 'ia',
+            }.get(mode, mode)
+            writeback = operands[0].strip().endswith('!')
+            base = self.reg(operands[0].strip().rstrip('!'))
+            reglist = ','.join(operands[1:])
+
+        regs = parse_reglist(reglist, self.reg)
+        if self.regs[base] is None:
+            raise ModelError(f'can\'t resolve the address of "{self.step.line}"')
+
+        n = len(regs)
+        start = self.regs[base]
+        if mode in ('db', 'da'):
+            start -= 4 * n
+        if mode in ('ib', 'db'):
+            start += 4 if mode == 'ib' else 0
+        if mode == 'da':
+            start += 4
+
+        for i, reg in enumerate(regs):
+            address = start + 4 * i
+            if load:
+                value = self.read(address, 4, seq=i > 0)
+                self.regs[reg] = value
+            else:
+                self.write(address, 4, self.regs[reg], seq=i > 0)
+
+        if load:
+            self.internal(1)
+
+        if writeback:
+            self.regs[base] = (self.regs[base] + (4 * n if mode in ('ia', 'ib') else -4 * n)) & 0xFFFFFFFF
+
+        if load and 15 in regs:
+            self.branch_refill()
+
+    def swap(self, byte, operands):
+        width = 1 if byte else 4
+        address, _, _ = self.address(operands[2])
+        if address is None:
+            raise ModelError(f'can\'t resolve the address of "{self.step.line}"')
+        value = self.read(address, width)
+        self.write(address, width, self.value_of(operands[1]))
+        self.internal(1)
+        self.set_reg(operands[0], value)
+
+    def multiply(self, op, operands):
+        rs = self.value_of(operands[-1] if op in ('mul',) else operands[3 if op != 'mla' else 2])
+        if rs is None:
+            m = 4
+        else:
+            m = 4
+            for i, mask in enumerate((0xFFFFFF00, 0xFFFF0000, 0xFF000000), start=1):
+                if rs & mask in (0, mask):
+                    m = i
+                    break
+
+        extra = {'mul': 0, 'mla': 1, 'umull': 1, 'smull': 1, 'umlal': 2, 'smlal': 2}[op]
+        self.internal(m + extra)
+
+        if op == 'mul':
+            a = self.value_of(operands[1])
+            b = self.value_of(operands[2] if len(operands) > 2 else operands[0])
+            self.set_reg(operands[0], None if a is None or b is None else a * b)
+        elif op == 'mla':
+            a, b, c = (self.value_of(x) for x in operands[1:4])
+            self.set_reg(operands[0], None if None in (a, b, c) else a * b + c)
+        else:
+            self.set_reg(operands[0], None)
+            self.set_reg(operands[1], None)
+
+    def branch(self):
+        self.branch_refill()
+
+    def branch_refill(self):
+        """Refill the pipeline: the target is assumed to be the next line."""
+
+        size = 2 if self.thumb else 4
+        self.last = None
+        self.bus('fetch', self.pc + size, size)
+        self.bus('fetch', self.pc + 2 * size, size)
+
+
+def shift_value(kind, value, amount):
+    if kind == 'lsl':
+        return (value << amount) & 0xFFFFFFFF if amount < 32 else 0
+    if kind == 'lsr':
+        return value >> amount if amount < 32 else 0
+    if kind == 'asr':
+        if value & 0x80000000:
+            value -= 1 << 32
+        return (value >> min(amount, 31)) & 0xFFFFFFFF
+    amount %= 32
+    return ((value >> amount) | (value << (32 - amount))) & 0xFFFFFFFF
+
+
+def split_operands(text):
+    operands = []
+    depth = 0
+    current = ''
+    for c in text:
+        if c in '[{':
+            depth += 1
+        elif c in ']}':
+            depth -= 1
+        if c == ',' and depth == 0:
+            operands.append(current.strip())
+            current = ''
+        else:
+            current += c
+    if current.strip():
+        operands.append(current.strip())
+    return operands
+
+
+def parse_reglist(text, reg):
+    regs = []
+    for part in text.strip().strip('{}').split(','):
+        part = part.strip()
+        if '-' in part:
+            first, last = (reg(x) for x in part.split('-'))
+            regs.extend(range(first, last + 1))
+        elif part:
+            regs.append(reg(part))
+    return sorted(set(regs))
+
+
+def format_result(result):
+    lines = []
+    for step in result.steps:
+        lines.append(f'{step.start:6} {step.cycles:4}  {step.line:<32} {" + ".join(step.detail)}')
+    lines.append(f'Total: {result.cycles} cycles')
+    for line, address, value in result.loads:
+        lines.append(f'Read 0x{value:04X} from 0x{address:08X} ({line})')
+    for name, value in sorted(result.samples.items()):
+        lines.append(f'{name} = ' + ('?' if value is None else f'0x{value:04X}'))
+    return '\n'.join(lines)
+
+
+# Suites
+
+@dataclass
+class SuiteTest:
+    idx: int
+    thumb: bool
+    asm: str
+    samples: list
+    expected: dict
+
+
+def c_strings(text):
+    """Concatenate the C string literals of `text`, unescaped."""
+
+    out = ''
+    for literal in re.findall(r'"((?:[^"\\]|\\.)*)"', text):
+        out += literal.encode().decode('unicode_escape')
+    return out
+
+
+def split_asm(text):
+    """Split the operands of an `__asm__` statement on the colons outside of strings."""
+
+    sections = ['']
+    quoted = False
+    escaped = False
+    for c in text:
+        if quoted:
+            escaped = c == '\\' and not escaped
+            quoted = c != '"' or escaped
+        elif c == '"':
+            quoted = True
+        elif c == ':':
+            sections.append('')
+            continue
+        sections[-1] += c
+    return sections
+
+
+def parse_suite(path):
+    """Find the harness tests of a suite written in inline assembly."""
+
+    with open(path) as f:
+        source = f.read()
+
+    kinds = re.findall(r'REGISTER_HARNESS_TEST\([^,]+,[^,]+,\s*(TEST_KIND_\w+)', source)
+    if 'REGISTER_HARNESS_TEST_ALL_KINDS(' in source:
+        kinds += list(KIND_CONFIGS)
+
+    tables = {}
+    for match in re.finditer(r'(\w+)\[TEST_KIND_MAX\]\[HARNESS_WAITSTATES_MAX\]\[\d+\]\s*=\s*{(.*?)};', source, re.S):
+        tables[match.group(1)] = {
+            (kind, int(n) | (int(s) << 2)): [int(x, 0) for x in values.split(',') if x.strip()]
+            for kind, n, s, values in re.findall(
+                r'\[(TEST_KIND_\w+)\]\[HARNESS_WS\((\d+),\s*(\d+)\)\]\s*=\s*{([^}]*)}',
+                match.group(2),
+            )
+        }
+
+    # NEW_TEST(idx, arm_table, {...}) or NEW_TEST(idx, arm_table, thumb_table, {...})
+    tests = []
+    for match in re.finditer(r'NEW_TEST\((\d+),\s*(\w+),\s*(?:(\w+),\s*)?{(.*?)\n}\);', source, re.S):
+        body = match.group(4)
+        asm = re.search(r'__asm__\s+(?:volatile\s*)?\((.*?)\);', body, re.S)
+        if asm is None:
+            continue
+
+        sections = split_asm(asm.group(1))
+        outputs = sections[1] if len(sections) > 1 else ''
+        samples = [
+            (name, int(idx))
+            for name, idx in re.findall(r'\[(\w+)\]\s*"=r"\s*\(\s*samples\[(\d+)\]\s*\)', outputs)
+        ]
+        idx = int(match.group(1))
+        code = c_strings(sections[0])
+
+        tests.append(SuiteTest(idx, False, code, samples, tables.get(match.group(2), {})))
+        if match.group(3):
+            tests.append(SuiteTest(idx, True, code, samples, tables.get(match.group(3), {})))
+
+    return tests, list(dict.fromkeys(kinds))
+
+
+def run_suite(path, waitcnt, check):
+    import hades_report
+    from goldens import print_tables
+
+    kinds = {name: value for value, name in hades_report.kind_names().items()}
+    tests, registered = parse_suite(path)
+
+    entries = []
+    mismatches = 0
+    for test in tests:
+        for kind in registered:
+            region, prefetch, shift = KIND_CONFIGS[kind]
+
+            for ws in range(HARNESS_WAITSTATES_MAX if shift is not None else 1):
+                config = waitcnt if shift is None else (waitcnt & ~(0x7 << shift)) | (ws << shift)
+                result = Model(region, config, prefetch, test.thumb).run(test.asm)
+
+                measured = [0] * len(test.samples)
+                for name, idx in test.samples:
+                    value = result.samples.get(name)
+                    measured[idx] = 0xDEAD if value is None else value & 0xFFFF
+
+                variant = kinds[kind] | (ws << 8) | (hades_report.HARNESS_VARIANT_THUMB if test.thumb else 0)
+                entries.append(hades_report.Entry(0, 0, test.idx, variant, measured, []))
+
+                expected = test.expected.get((kind, ws))
+                if check and expected is not None and any(expected) and expected != measured:
+                    mismatches += 1
+                    print(
+                        f'{path}: test {test.idx} {hades_report.variant_name(variant, hades_report.kind_names())}: model gives '
+                        + ', '.join(f'0x{x:04X}' for x in measured)
+                        + ', expected '
+                        + ', '.join(f'0x{x:04X}' for x in expected),
+                        file=sys.stderr,
+                    )
+
+    if check:
+        checked = sum(len(test.expected) for test in tests)
+        print(f'{checked - mismatches}/{checked} match')
+        return 1 if mismatches else 0
+
+    print_tables(entries, hades_report.kind_names(), sys.stdout, harness=True)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('file', nargs='?', help='instruction sequence (default: stdin)')
+    parser.add_argument('--region', default='iwram', choices=REGION_BASES.keys(), help='where the code runs from (default: %(default)s)')
+    parser.add_argument('--waitcnt', type=lambda x: int(x, 0), default=0x0000, help='value of WAITCNT (default: 0x0000)')
+    parser.add_argument('--prefetch', action='store_true', help='enable the GamePak prefetcher')
+    parser.add_argument('--thumb', action='store_true', help='the code is THUMB')
+    parser.add_argument('--suite', help='compute the tables of the harness tests of this suite')
+    parser.add_argument('--check', action='store_true', help='with --suite, compare with the tables of the suite')
+    args = parser.parse_args()
+
+    try:
+        if args.suite:
+            return run_suite(args.suite, args.waitcnt, args.check)
+
+        source = open(args.file).read() if args.file else sys.stdin.read()
+        model = Model(args.region, args.waitcnt, args.prefetch or None, args.thumb)
+        print(format_result(model.run(source)))
+    except ModelError as e:
+        print(f'error: {e}', file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())